@@ -0,0 +1,66 @@
+project "bench"
+	kind "ConsoleApp"
+	language "C++"
+	cppdialect "C++20"
+	staticruntime "on"
+
+	targetdir "../bin"
+
+	architecture "x86_64"
+
+	pic "on"
+
+	files {
+		"src/**.hpp",
+		"src/**.cpp",
+	}
+
+	includedirs {
+		"../vkr/include",
+		"../vkr/ext/ecs/include"
+	}
+
+	links {
+		"vkr",
+		"ecs"
+	}
+
+	defines {
+		"VKR_IMPORT_SYMBOLS"
+	}
+
+	filter { "system:linux", "configurations:release" }
+		postbuildcommands {
+			"cd ../ && ./bin/packer res/ ./bin/bench"
+		}
+
+	filter { "system:windows", "configurations:release" }
+		postbuildcommands {
+			"cd \"$(SolutionDir)\" && bin\\packer.exe res bin\\bench.exe"
+		}
+
+	filter "system:windows"
+		defines {
+			"_CRT_SECURE_NO_WARNINGS"
+		}
+
+	filter "options:profile"
+		defines {
+			"VKR_PROFILE"
+		}
+
+	filter "configurations:debug"
+		runtime "debug"
+		symbols "on"
+
+		defines {
+			"DEBUG"
+		}
+
+	filter "configurations:release"
+		runtime "release"
+		optimize "on"
+
+		defines {
+			"RELEASE"
+		}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+
+#include <vkr/vkr.hpp>
+
+using namespace vkr;
+
+/* Runs `f' `iterations' times and returns the average time per call
+ * in nanoseconds. */
+template <typename F>
+f64 time_ns(usize iterations, F f) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (usize i = 0; i < iterations; i++) {
+		f();
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+
+	return (f64)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / (f64)iterations;
+}
+
+/* Written to after each benchmark so that the compiler can't throw
+ * the work away. */
+extern volatile f32 bench_sink;
+
+void run_maths_benchmarks(usize iterations);
+
+/* The scene that the frame suite renders, set from the command line.
+ * The defaults are close to the sandbox. */
+struct FrameBenchConfig {
+	usize monkeys = 2;
+	usize lights = 2;
+	usize windows = 0; /* Of UI. */
+	usize glyphs = 0;  /* Of text, drawn outside of the UI. */
+
+	bool windowed = false;
+
+	/* Where to write a report of the run as JSON; "-" for stdout. */
+	const char* json_path = null;
+};
+
+extern FrameBenchConfig frame_config;
+
+/* Each iteration is one frame. */
+void run_frame_benchmark(usize iterations);
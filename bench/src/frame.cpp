@@ -0,0 +1,505 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <ecs/ecs.hpp>
+
+#include "bench.hpp"
+
+/* Renders a generated scene for a fixed number of frames and reports
+ * how long they took. The scene is a grid of monkeys lit by randomly
+ * placed point lights, with optional UI windows and text on top, and
+ * the camera orbits it once over the run. Nothing depends on the time
+ * step or on the clock, so every run with the same config draws exactly
+ * the same frames. */
+
+static constexpr usize warmup_frames = 10;
+
+/* How many of each kind of quad a UI window is budgeted for. */
+static constexpr usize quads_per_window = 256;
+static constexpr usize glyphs_per_line = 128;
+
+/* Per-frame samples, in milliseconds. The histograms in FrameTimeHistogram
+ * are too coarse to compare runs with each other. */
+struct Samples {
+	std::vector<f64> ms;
+
+	inline void add(f64 v) { ms.push_back(v); }
+
+	f64 mean() const {
+		if (ms.empty()) { return 0.0; }
+
+		f64 total = 0.0;
+		for (f64 v : ms) { total += v; }
+		return total / (f64)ms.size();
+	}
+
+	/* Nearest rank. */
+	f64 percentile(f64 p) const {
+		if (ms.empty()) { return 0.0; }
+
+		std::vector<f64> sorted = ms;
+		std::sort(sorted.begin(), sorted.end());
+
+		usize rank = (usize)ceil(p * (f64)sorted.size());
+		return sorted[std::clamp(rank, (usize)1, sorted.size()) - 1];
+	}
+
+	void write_json(FILE* file, const char* name, bool last = false) const {
+		if (ms.empty()) {
+			fprintf(file, "\t\"%s\": null%s\n", name, last ? "" : ",");
+			return;
+		}
+
+		fprintf(file, "\t\"%s\": { \"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }%s\n",
+			name, mean(), percentile(0.5), percentile(0.9), percentile(0.95), percentile(0.99), percentile(1.0), last ? "" : ",");
+	}
+};
+
+class FrameBenchApp : public App {
+private:
+	FrameBenchConfig config;
+
+	usize frame_count;
+	usize frame;
+
+	Renderer3D* renderer;
+	Renderer3D::ShaderConfig shaders;
+
+	Renderer2D* renderer2d;
+	Shader* sprite_shader;
+
+	UIContext* ui;
+	Font* font;
+
+	Model3D* monkey;
+	Model3D* cube;
+
+	Texture* wall_a;
+	Texture* wall_n;
+	Texture* wood_a;
+
+	ecs::World world;
+
+	ecs::Entity camera;
+
+	f32 orbit_radius;
+
+	std::vector<std::string> window_titles;
+	std::string text;
+
+	Samples frame_ms, cpu_ms, gpu_ms;
+
+	/* The time between the ends of two on_updates is a whole frame,
+	 * present and pacing included. The ts passed to on_update can't be
+	 * used, as it belongs to the frame before. */
+	std::chrono::steady_clock::time_point last_update_end;
+
+	/* Summed over the measured frames. */
+	struct {
+		usize scene_draws;
+		usize shadow_casters_drawn;
+		usize shadow_cascades_rendered;
+		usize point_lights_visible;
+		usize ui_draws;
+		usize ui_quads;
+		usize ui_quads_dropped;
+	} totals;
+
+	void build_scene() {
+		Renderer3D::Material materials[] = {
+			{
+				.diffuse_map = wall_a,
+				.normal_map = wall_n,
+				.emissive = 0.0f,
+				.diffuse = v3f(1.0f),
+				.specular = v3f(1.0f),
+				.ambient = v3f(1.0f)
+			},
+			{
+				.diffuse_map = wood_a,
+				.normal_map = null,
+				.emissive = 0.0f,
+				.diffuse = v3f(1.0f),
+				.specular = v3f(1.0f),
+				.ambient = v3f(1.0f)
+			},
+			{
+				.diffuse_map = null,
+				.normal_map = null,
+				.emissive = 0.0f,
+				.diffuse = v3f(1.0f),
+				.specular = v3f(1.0f),
+				.ambient = v3f(1.0f)
+			},
+			{
+				.diffuse_map = null,
+				.normal_map = null,
+				.emissive = 5.0f,
+				.diffuse = v3f(1.0f, 0.3f, 0.3f),
+				.specular = v3f(1.0f, 0.3f, 0.3f),
+				.ambient = v3f(1.0f, 0.3f, 0.3f)
+			}
+		};
+
+		renderer = new Renderer3D(this, video, shaders, materials, 4, Renderer3D::GBufferLayout::compact);
+
+		renderer->sun.direction = v3f(0.3f, 1.0f, 0.8f);
+		renderer->sun.intensity = 1.0f;
+		renderer->sun.specular = v3f(1.0f, 1.0f, 1.0f);
+		renderer->sun.diffuse = v3f(1.0f, 1.0f, 1.0f);
+
+		/* The monkeys go on a square grid, centred on the origin. */
+		const f32 spacing = 3.0f;
+		usize side = std::max((usize)ceil(sqrt((f64)config.monkeys)), (usize)1);
+		f32 extent = (f32)side * spacing * 0.5f;
+
+		for (usize i = 0; i < config.monkeys; i++) {
+			v3f position(
+				((f32)(i % side) + 0.5f) * spacing - extent,
+				0.0f,
+				((f32)(i / side) + 0.5f) * spacing - extent);
+
+			auto e = world.new_entity();
+			e.add(Transform { m4f::translate(m4f::identity(), position) });
+			e.add(Renderable3D { monkey, i % 4 });
+		}
+
+		auto ground = world.new_entity();
+		ground.add(Transform {
+			m4f::translate(m4f::identity(), v3f(0.0f, -2.0f, 0.0f)) *
+			m4f::scale(m4f::identity(), v3f(extent + 5.0f, 0.1f, extent + 5.0f))});
+		ground.add(Renderable3D { cube, 2 });
+
+		auto monolith = world.new_entity();
+		monolith.add(Transform {
+			m4f::translate(m4f::identity(), v3f(0.0f, -2.0f, 0.0f)) *
+			m4f::scale(m4f::identity(), v3f(1.0f, 5.0f, 1.0f))});
+		monolith.add(Renderable3D { cube, 1 });
+
+		/* Seeded, so that the lights are in the same places every run. */
+		std::mt19937 rng(1);
+		std::uniform_real_distribution<f32> unit_dist(0.0f, 1.0f);
+		std::uniform_real_distribution<f32> position_dist(-extent - 2.0f, extent + 2.0f);
+		std::uniform_real_distribution<f32> height_dist(-1.5f, 2.0f);
+
+		for (usize i = 0; i < config.lights; i++) {
+			v3f color(unit_dist(rng), unit_dist(rng), unit_dist(rng));
+
+			auto e = world.new_entity();
+			e.add(Transform { m4f::translate(m4f::identity(), v3f(position_dist(rng), height_dist(rng), position_dist(rng))) });
+			e.add(PointLight {
+				.intensity = 5.0f + unit_dist(rng) * 20.0f,
+				.specular = color,
+				.diffuse = color,
+				.range = 1.0f + unit_dist(rng) * 3.0f
+			});
+		}
+
+		camera = world.new_entity();
+		camera.add(Camera {
+			.position = { 0.0f, 0.0f, 0.0f },
+			.rotation = { 0.0f, 0.0f, 0.0f },
+			.active = true,
+			.fov = 70.0f,
+			.near = 0.1f,
+			.far = 100.0f
+		});
+
+		orbit_radius = std::max(extent * 1.5f, 6.0f);
+
+		for (usize i = 0; i < config.windows; i++) {
+			window_titles.push_back("Window " + std::to_string(i));
+		}
+
+		for (usize i = 0; i < config.glyphs; i++) {
+			if (i > 0 && i % glyphs_per_line == 0) {
+				text += '\n';
+			}
+
+			text += (char)('a' + i % 26);
+		}
+	}
+
+	/* Once around the scene over the measured frames, looking at
+	 * the middle of it. */
+	void move_camera() {
+		usize measured_frame = frame > warmup_frames ? frame - warmup_frames : 0;
+		f32 t = (f32)measured_frame / (f32)std::max(frame_count, (usize)1);
+		f32 angle = t * 2.0f * 3.14159265f;
+
+		v3f position(sinf(angle) * orbit_radius, orbit_radius * 0.4f, cosf(angle) * orbit_radius);
+		v3f dir = v3f::normalised(-position);
+
+		Camera& cam = camera.get<Camera>();
+		cam.position = position;
+		cam.rotation.x = to_deg(asinf(dir.y));
+		cam.rotation.y = to_deg(atan2f(dir.x, dir.z));
+	}
+
+	void build_ui() {
+		ui->begin(get_size());
+		ui->use_font(font);
+
+		for (usize i = 0; i < window_titles.size(); i++) {
+			v2f position(10.0f + (f32)(i % 8) * 230.0f, 10.0f + (f32)((i / 8) % 6) * 170.0f);
+
+			if (ui->begin_window(window_titles[i].c_str(), position, v2f(220.0f, 160.0f))) {
+				static f32 value = 0.5f;
+
+				ui->columns(2, 0.5f, 0.5f);
+				ui->label("Label");
+				ui->button("Button");
+				ui->label("Slider");
+				ui->slider(&value);
+				ui->columns(1, 1.0f);
+				ui->text("Frame %llu", (unsigned long long)frame);
+
+				ui->end_window();
+			}
+		}
+
+		ui->end();
+	}
+public:
+	FrameBenchApp(const FrameBenchConfig& config, usize frame_count) :
+		App("Frame Benchmark", v2i(1920, 1080)), config(config), frame_count(frame_count), frame(0) {
+		headless = !config.windowed;
+		totals = {};
+	}
+
+	void on_init() override {
+		video->gpu_timers = true;
+
+		shaders.lit = Shader::from_file(video,
+			"res/shaders/lit_compact_gbuffer.vert.spv",
+			"res/shaders/lit_compact_gbuffer.frag.spv");
+		shaders.tonemap = Shader::from_file(video,
+			"res/shaders/tonemap.vert.spv",
+			"res/shaders/tonemap.frag.spv");
+		shaders.bright_extract = Shader::from_file(video,
+			"res/shaders/bright_extract.vert.spv",
+			"res/shaders/bright_extract.frag.spv");
+		shaders.bloom_downsample = Shader::from_file(video,
+			"res/shaders/bloom_downsample.vert.spv",
+			"res/shaders/bloom_downsample.frag.spv");
+		shaders.bloom_upsample = Shader::from_file(video,
+			"res/shaders/bloom_upsample.vert.spv",
+			"res/shaders/bloom_upsample.frag.spv");
+		shaders.composite = Shader::from_file(video,
+			"res/shaders/composite.vert.spv",
+			"res/shaders/composite.frag.spv");
+		shaders.tonemap_composite = Shader::from_file(video,
+			"res/shaders/tonemap_composite.vert.spv",
+			"res/shaders/tonemap_composite.frag.spv");
+		shaders.shadowmap = Shader::from_file(video,
+			"res/shaders/shadowmap.vert.spv",
+			"res/shaders/shadowmap.frag.spv");
+		shaders.lighting = Shader::from_file(video,
+			"res/shaders/lighting_compact_gbuffer.vert.spv",
+			"res/shaders/lighting_compact_gbuffer.frag.spv");
+		sprite_shader = Shader::from_file(video,
+			"res/shaders/2d.vert.spv",
+			"res/shaders/2d.frag.spv");
+
+		font = new Font("res/fonts/DejaVuSans.ttf", 14.0f);
+
+		renderer2d = new Renderer2D(video, sprite_shader, null, 0, get_default_framebuffer(),
+			config.glyphs + config.windows * quads_per_window + 1024);
+
+		ui = new UIContext(this);
+
+		auto monkey_obj = WavefrontModel::from_file("res/models/monkey.obj");
+		monkey = Model3D::from_wavefront(video, monkey_obj);
+		delete monkey_obj;
+
+		auto cube_obj = WavefrontModel::from_file("res/models/cube.obj");
+		cube = Model3D::from_wavefront(video, cube_obj);
+		delete cube_obj;
+
+		wall_a = Texture::from_file(video, "res/textures/walla.jpg", Texture::Flags::filter_linear);
+		wall_n = Texture::from_file(video, "res/textures/walln.png", Texture::Flags::filter_linear);
+		wood_a = Texture::from_file(video, "res/textures/wooda.jpg", Texture::Flags::filter_linear);
+
+		build_scene();
+	}
+
+	void on_update(f64) override {
+		auto start = std::chrono::steady_clock::now();
+
+		/* The first frames pay for pipeline creation and the like. The
+		 * camera stays put until they're done. */
+		bool measured = frame >= warmup_frames;
+		if (measured) {
+			/* The App adds each frame to the histogram once it's over, so
+			 * the last warm-up frame is in by now. */
+			if (frame == warmup_frames) {
+				frame_times.reset();
+			}
+
+			/* The GPU's timers lag behind by the frames in flight, but
+			 * that doesn't matter over a steady run. */
+			f64 gpu_total = 0.0;
+			for (const auto& timing : video->get_gpu_timings()) {
+				if (timing.depth == 0) { gpu_total += timing.ms; }
+			}
+
+			if (!video->get_gpu_timings().empty()) {
+				gpu_ms.add(gpu_total);
+			}
+		}
+
+		move_camera();
+
+		if (!window_titles.empty()) {
+			build_ui();
+		}
+
+		renderer->draw(&world, camera);
+
+		get_default_framebuffer()->begin();
+
+		renderer->draw_to_default_framebuffer();
+
+		renderer2d->begin(get_size());
+		if (!window_titles.empty()) {
+			ui->draw(renderer2d);
+		}
+
+		if (!text.empty()) {
+			renderer2d->push(font, text.c_str(), v2f(10.0f, 10.0f));
+		}
+		renderer2d->end();
+
+		get_default_framebuffer()->end();
+
+		auto end = std::chrono::steady_clock::now();
+
+		if (measured) {
+			cpu_ms.add(std::chrono::duration<f64, std::milli>(end - start).count());
+			frame_ms.add(std::chrono::duration<f64, std::milli>(end - last_update_end).count());
+
+			totals.scene_draws              += renderer->stats.scene_draws;
+			totals.shadow_casters_drawn     += renderer->stats.shadow_casters_drawn;
+			totals.shadow_cascades_rendered += renderer->stats.shadow_cascades_rendered;
+			totals.point_lights_visible     += renderer->stats.point_lights_visible;
+			totals.ui_draws                 += renderer2d->stats.draws;
+			totals.ui_quads                 += renderer2d->stats.quads;
+			totals.ui_quads_dropped         += renderer2d->stats.quads_dropped;
+
+			/* The App finishes this frame, and adds it to frame_times,
+			 * before it stops. */
+			if (frame - warmup_frames + 1 >= frame_count) {
+				quit();
+			}
+		}
+
+		last_update_end = end;
+		frame++;
+	}
+
+	void write_report(FILE* file) {
+		auto memory = video->get_memory_usage();
+
+		f64 frames = (f64)std::max(frame_ms.ms.size(), (usize)1);
+
+		fprintf(file, "{\n");
+		fprintf(file, "\t\"frames\": %llu,\n", (unsigned long long)frame_ms.ms.size());
+		fprintf(file, "\t\"width\": %d,\n", get_size().x);
+		fprintf(file, "\t\"height\": %d,\n", get_size().y);
+		fprintf(file, "\t\"headless\": %s,\n", headless ? "true" : "false");
+		fprintf(file, "\t\"scene\": { \"monkeys\": %llu, \"lights\": %llu, \"windows\": %llu, \"glyphs\": %llu },\n",
+			(unsigned long long)config.monkeys, (unsigned long long)config.lights,
+			(unsigned long long)config.windows, (unsigned long long)config.glyphs);
+		frame_ms.write_json(file, "frame_ms");
+		cpu_ms.write_json(file, "cpu_ms");
+		gpu_ms.write_json(file, "gpu_ms");
+		fprintf(file, "\t\"per_frame\": { \"scene_draws\": %.2f, \"shadow_casters_drawn\": %.2f, \"shadow_cascades_rendered\": %.2f, "
+			"\"point_lights_visible\": %.2f, \"ui_draws\": %.2f, \"ui_quads\": %.2f, \"ui_quads_dropped\": %.2f },\n",
+			(f64)totals.scene_draws / frames, (f64)totals.shadow_casters_drawn / frames,
+			(f64)totals.shadow_cascades_rendered / frames, (f64)totals.point_lights_visible / frames,
+			(f64)totals.ui_draws / frames, (f64)totals.ui_quads / frames, (f64)totals.ui_quads_dropped / frames);
+		fprintf(file, "\t\"memory\": { \"allocated\": %llu, \"reserved\": %llu }\n",
+			(unsigned long long)memory.allocated, (unsigned long long)memory.reserved);
+		fprintf(file, "}\n");
+	}
+
+	void on_deinit() override {
+		frame_times.print();
+
+		info("CPU: mean %.2fms, 95%% %.2fms; GPU: mean %.2fms, 95%% %.2fms.",
+			cpu_ms.mean(), cpu_ms.percentile(0.95), gpu_ms.mean(), gpu_ms.percentile(0.95));
+
+		for (const auto& timing : video->get_gpu_timings()) {
+			info("GPU %*s%-24s %8.3f ms", (i32)timing.depth * 2, "", timing.name, timing.ms);
+		}
+
+		if (config.json_path) {
+			if (strcmp(config.json_path, "-") == 0) {
+				write_report(stdout);
+			} else {
+				FILE* file = fopen(config.json_path, "w");
+				if (file) {
+					write_report(file);
+					fclose(file);
+				} else {
+					error("Failed to open `%s' for writing.", config.json_path);
+				}
+			}
+		}
+
+		/* A black or uniform frame means nothing was drawn, which would
+		 * make the numbers above meaningless. */
+		if (headless) {
+			Framebuffer* fb = get_default_framebuffer();
+			v2i size = fb->get_scaled_size();
+
+			std::vector<u8> pixels((usize)size.x * (usize)size.y * 4);
+			if (fb->read_back(0, pixels.data())) {
+				u64 sum[3] = { 0, 0, 0 };
+				for (usize i = 0; i < pixels.size(); i += 4) {
+					sum[0] += pixels[i + 0];
+					sum[1] += pixels[i + 1];
+					sum[2] += pixels[i + 2];
+				}
+
+				usize pixel_count = pixels.size() / 4;
+				info("Average colour of the last frame: %llu, %llu, %llu.",
+					(unsigned long long)(sum[0] / pixel_count),
+					(unsigned long long)(sum[1] / pixel_count),
+					(unsigned long long)(sum[2] / pixel_count));
+			}
+		}
+
+		delete ui;
+		delete renderer2d;
+		delete renderer;
+		delete monkey;
+		delete cube;
+		delete wall_a;
+		delete wall_n;
+		delete wood_a;
+		delete font;
+		delete sprite_shader;
+		delete shaders.lit;
+		delete shaders.tonemap;
+		delete shaders.bright_extract;
+		delete shaders.bloom_downsample;
+		delete shaders.bloom_upsample;
+		delete shaders.composite;
+		delete shaders.tonemap_composite;
+		delete shaders.shadowmap;
+		delete shaders.lighting;
+	}
+};
+
+void run_frame_benchmark(usize iterations) {
+	FrameBenchApp* app = new FrameBenchApp(frame_config, iterations);
+	app->run();
+	delete app;
+}
@@ -0,0 +1,64 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.hpp"
+
+volatile f32 bench_sink;
+
+FrameBenchConfig frame_config;
+
+struct Suite {
+	const char* name;
+	void (*run)(usize iterations);
+};
+
+static Suite suites[] = {
+	{ "maths", run_maths_benchmarks },
+	{ "frame", run_frame_benchmark },
+};
+
+i32 main(i32 argc, const char** argv) {
+	usize iterations = 100;
+	const char* only = null;
+
+	for (i32 i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			iterations = (usize)atoll(argv[++i]);
+		} else if (strcmp(argv[i], "-monkeys") == 0 && i + 1 < argc) {
+			frame_config.monkeys = (usize)atoll(argv[++i]);
+		} else if (strcmp(argv[i], "-lights") == 0 && i + 1 < argc) {
+			frame_config.lights = (usize)atoll(argv[++i]);
+		} else if (strcmp(argv[i], "-windows") == 0 && i + 1 < argc) {
+			frame_config.windows = (usize)atoll(argv[++i]);
+		} else if (strcmp(argv[i], "-glyphs") == 0 && i + 1 < argc) {
+			frame_config.glyphs = (usize)atoll(argv[++i]);
+		} else if (strcmp(argv[i], "-json") == 0 && i + 1 < argc) {
+			frame_config.json_path = argv[++i];
+		} else if (strcmp(argv[i], "-windowed") == 0) {
+			frame_config.windowed = true;
+		} else {
+			only = argv[i];
+		}
+	}
+
+	init_packer(argc, argv);
+
+	bool found = false;
+	for (const auto& suite : suites) {
+		if (only && strcmp(only, suite.name) != 0) { continue; }
+
+		info("Running `%s' (%llu iterations).", suite.name, (unsigned long long)iterations);
+		suite.run(iterations);
+		found = true;
+	}
+
+	if (!found) {
+		info("Usage: %s [-n iterations] [suite].", argv[0]);
+		info("The frame suite also takes [-monkeys n] [-lights n] [-windows n] [-glyphs n] [-windowed] [-json path].");
+		abort_with("No such suite `%s'.", only);
+	}
+
+	deinit_packer();
+
+	return 0;
+}
@@ -0,0 +1,97 @@
+#include <stdlib.h>
+
+#include <vector>
+
+#include "bench.hpp"
+
+/* Compares the m4f kernels against the plain scalar versions
+ * that they replaced. Each iteration runs over a batch of random
+ * matrices, so that the numbers aren't all cache hits on one value. */
+
+static constexpr usize batch_size = 4096;
+
+static f32 random_f32() {
+	return ((f32)rand() / (f32)RAND_MAX) * 2.0f - 1.0f;
+}
+
+static m4f random_m4f() {
+	m4f r;
+
+	for (u32 x = 0; x < 4; x++) {
+		for (u32 y = 0; y < 4; y++) {
+			r.m[x][y] = random_f32() + (x == y ? 2.0f : 0.0f);
+		}
+	}
+
+	return r;
+}
+
+static void report(const char* name, f64 scalar_ns, f64 fast_ns) {
+	info("%-20s scalar: %9.2f ns/op  simd: %9.2f ns/op  (%.2fx)", name,
+		scalar_ns / (f64)batch_size, fast_ns / (f64)batch_size, scalar_ns / fast_ns);
+}
+
+void run_maths_benchmarks(usize iterations) {
+	std::vector<m4f> as(batch_size), bs(batch_size), out(batch_size);
+	std::vector<v4f> vs(batch_size), vout(batch_size);
+	std::vector<AABB> boxes(batch_size), bout(batch_size);
+
+	srand(1);
+
+	for (usize i = 0; i < batch_size; i++) {
+		as[i] = random_m4f();
+		bs[i] = random_m4f();
+		vs[i] = v4f(random_f32(), random_f32(), random_f32(), 1.0f);
+
+		v3f c(random_f32(), random_f32(), random_f32());
+		boxes[i] = AABB { c - v3f(0.5f), c + v3f(0.5f) };
+	}
+
+	f64 s, f;
+
+	s = time_ns(iterations, [&]() { for (usize i = 0; i < batch_size; i++) { out[i] = scalar::mul(as[i], bs[i]); } });
+	f = time_ns(iterations, [&]() { for (usize i = 0; i < batch_size; i++) { out[i] = as[i] * bs[i]; } });
+	report("m4f * m4f", s, f);
+	bench_sink = out[batch_size / 2].m[1][2];
+
+	s = time_ns(iterations, [&]() { for (usize i = 0; i < batch_size; i++) { out[i] = scalar::inverse(as[i]); } });
+	f = time_ns(iterations, [&]() { for (usize i = 0; i < batch_size; i++) { out[i] = as[i].inverse(); } });
+	report("inverse", s, f);
+	bench_sink = out[batch_size / 2].m[1][2];
+
+	s = time_ns(iterations, [&]() { for (usize i = 0; i < batch_size; i++) { out[i] = scalar::transposed(as[i]); } });
+	f = time_ns(iterations, [&]() { for (usize i = 0; i < batch_size; i++) { out[i] = as[i].transposed(); } });
+	report("transpose", s, f);
+	bench_sink = out[batch_size / 2].m[1][2];
+
+	s = time_ns(iterations, [&]() { for (usize i = 0; i < batch_size; i++) { vout[i] = scalar::transform(as[i], vs[i]); } });
+	f = time_ns(iterations, [&]() { for (usize i = 0; i < batch_size; i++) { vout[i] = m4f::transform(as[i], vs[i]); } });
+	report("transform v4f", s, f);
+	bench_sink = vout[batch_size / 2].x;
+
+	s = time_ns(iterations, [&]() { for (usize i = 0; i < batch_size; i++) { bout[i] = scalar::transform(as[i], boxes[i]); } });
+	f = time_ns(iterations, [&]() { for (usize i = 0; i < batch_size; i++) { bout[i] = m4f::transform(as[i], boxes[i]); } });
+	report("transform AABB", s, f);
+	bench_sink = bout[batch_size / 2].min.x;
+
+	/* Array kernels. */
+	std::vector<v3f> points(batch_size), pout(batch_size);
+	for (usize i = 0; i < batch_size; i++) {
+		points[i] = v3f(random_f32(), random_f32(), random_f32());
+	}
+
+	s = time_ns(iterations, [&]() { scalar::transform_points(as[0], points.data(), pout.data(), batch_size); });
+	f = time_ns(iterations, [&]() { transform_points(as[0], points.data(), pout.data(), batch_size); });
+	report("transform_points", s, f);
+	bench_sink = pout[batch_size / 2].x;
+
+	s = time_ns(iterations, [&]() { scalar::transform_aabbs(as.data(), boxes.data(), bout.data(), batch_size); });
+	f = time_ns(iterations, [&]() { transform_aabbs(as.data(), boxes.data(), bout.data(), batch_size); });
+	report("transform_aabbs", s, f);
+	bench_sink = bout[batch_size / 2].min.x;
+
+	s = time_ns(iterations, [&]() { scalar::mul_matrices(as.data(), bs.data(), out.data(), batch_size); });
+	f = time_ns(iterations, [&]() { mul_matrices(as.data(), bs.data(), out.data(), batch_size); });
+	report("mul_matrices", s, f);
+	bench_sink = out[batch_size / 2].m[1][2];
+}
@@ -2,6 +2,16 @@ vk_sdk_path     = "$(VULKAN_SDK)"
 vk_include_path = string.format("%s/Include", vk_sdk_path)
 vk_lib_path     = string.format("%s/Lib",     vk_sdk_path)
 
+newoption {
+	trigger     = "avx",
+	description = "Use AVX in the maths kernels (the binaries will require a CPU that supports it)."
+}
+
+newoption {
+	trigger     = "profile",
+	description = "Compile in the CPU profiler's timers (see profiler.hpp)."
+}
+
 workspace "vkr"
 	configurations { "debug", "release" }
 
@@ -11,3 +21,4 @@ include "packer"
 
 include "vkr"
 include "sbox"
+include "bench"
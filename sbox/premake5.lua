@@ -44,6 +44,11 @@ project "sbox"
 			"_CRT_SECURE_NO_WARNINGS"
 		}
 
+	filter "options:profile"
+		defines {
+			"VKR_PROFILE"
+		}
+
 	filter "configurations:debug"
 		runtime "debug"
 		symbols "on"
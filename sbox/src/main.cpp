@@ -3,6 +3,7 @@
 #include <random>
 
 #include <vkr/vkr.hpp>
+#include <vkr/profiler.hpp>
 #include <ecs/ecs.hpp>
 
 #define camera_speed 3.0f
@@ -55,6 +56,8 @@ public:
 	SandboxApp() : App("Sandbox", vkr::v2i(1920, 1080)) {}
 
 	void on_init() override {
+		video->gpu_timers = true;
+
 		lock_mouse();
 		first_move = true;
 		camera_active = true;
@@ -62,29 +65,32 @@ public:
 		ui = new UIContext(this);
 
 		shaders.lit = Shader::from_file(video,
-			"res/shaders/lit.vert.spv",
-			"res/shaders/lit.frag.spv");
+			"res/shaders/lit_compact_gbuffer.vert.spv",
+			"res/shaders/lit_compact_gbuffer.frag.spv");
 		shaders.tonemap = Shader::from_file(video,
 			"res/shaders/tonemap.vert.spv",
 			"res/shaders/tonemap.frag.spv");
 		shaders.bright_extract = Shader::from_file(video,
 			"res/shaders/bright_extract.vert.spv",
 			"res/shaders/bright_extract.frag.spv");
-		shaders.blur_v = Shader::from_file(video,
-			"res/shaders/blur_v.vert.spv",
-			"res/shaders/blur_v.frag.spv");
-		shaders.blur_h = Shader::from_file(video,
-			"res/shaders/blur_h.vert.spv",
-			"res/shaders/blur_h.frag.spv");
+		shaders.bloom_downsample = Shader::from_file(video,
+			"res/shaders/bloom_downsample.vert.spv",
+			"res/shaders/bloom_downsample.frag.spv");
+		shaders.bloom_upsample = Shader::from_file(video,
+			"res/shaders/bloom_upsample.vert.spv",
+			"res/shaders/bloom_upsample.frag.spv");
 		shaders.composite = Shader::from_file(video,
 			"res/shaders/composite.vert.spv",
 			"res/shaders/composite.frag.spv");
+		shaders.tonemap_composite = Shader::from_file(video,
+			"res/shaders/tonemap_composite.vert.spv",
+			"res/shaders/tonemap_composite.frag.spv");
 		shaders.shadowmap = Shader::from_file(video,
 			"res/shaders/shadowmap.vert.spv",
 			"res/shaders/shadowmap.frag.spv");
 		shaders.lighting = Shader::from_file(video,
-			"res/shaders/lighting.vert.spv",
-			"res/shaders/lighting.frag.spv");
+			"res/shaders/lighting_compact_gbuffer.vert.spv",
+			"res/shaders/lighting_compact_gbuffer.frag.spv");
 		sprite_shader = Shader::from_file(video,
 			"res/shaders/2d.vert.spv",
 			"res/shaders/2d.frag.spv");
@@ -148,7 +154,7 @@ public:
 			}
 		};
 
-		renderer = new Renderer3D(this, video, shaders, materials, 4);
+		renderer = new Renderer3D(this, video, shaders, materials, 4, Renderer3D::GBufferLayout::compact);
 
 		camera = world.new_entity();
 		camera.add(Camera {
@@ -252,15 +258,23 @@ public:
 			ui->slider(&renderer->sun.softness, 0.0f, 1.0f);
 			ui->text("%.2f", renderer->sun.softness);
 
+			ui->label("Shadow Quality");
+			static const char* shadow_quality_names[] = { "Hard", "PCF", "PCSS Low", "PCSS High" };
+			i32 shadow_quality = static_cast<i32>(renderer->sun.quality);
+			if (ui->button(shadow_quality_names[shadow_quality])) {
+				renderer->sun.quality = static_cast<Renderer3D::ShadowQuality>((shadow_quality + 1) % 4);
+			}
+			ui->text("%d", shadow_quality);
+
 			ui->label("Blocker Samples");
 			static f32 new_blocker_search_sample_count = 36;
-			ui->slider(&new_blocker_search_sample_count, 0.0f, 128.0f);
+			ui->slider(&new_blocker_search_sample_count, 1.0f, 64.0f);
 			ui->text("%d", renderer->sun.blocker_search_sample_count);
 			renderer->sun.blocker_search_sample_count = static_cast<i32>(new_blocker_search_sample_count);
 
 			ui->label("PCF Samples");
 			static f32 new_pcf_sample_count = 64;
-			ui->slider(&new_pcf_sample_count, 0.0f, 128.0f);
+			ui->slider(&new_pcf_sample_count, 1.0f, 64.0f);
 			ui->text("%d", renderer->sun.pcf_sample_count);
 			renderer->sun.pcf_sample_count = static_cast<i32>(new_pcf_sample_count);
 
@@ -276,8 +290,8 @@ public:
 			ui->slider(&renderer->pp_config.bloom_threshold, 0.0f, 10.0f);
 			ui->text("%.2f", renderer->pp_config.bloom_threshold);
 
-			ui->label("Blur Intensity");
-			ui->slider(&renderer->pp_config.bloom_blur_intensity, 0.0f, 1000.0f);
+			ui->label("Blur Spread");
+			ui->slider(&renderer->pp_config.bloom_blur_intensity, 0.0f, 4.0f);
 			ui->text("%.2f", renderer->pp_config.bloom_blur_intensity);
 
 			ui->label("Intensity");
@@ -287,6 +301,13 @@ public:
 			ui->end_window();
 		}
 
+		/* Switch between the shadow quality tiers above to compare what
+		 * they cost in the lighting pass. */
+		if (ui->begin_window("GPU Timings", v2f(520.0f, 10.0f))) {
+			ui->gpu_timings(video);
+			ui->end_window();
+		}
+
 		if (ui->begin_window("Test Window", v2f(10.0f, 320.0f))) {
 			ui->columns(2, 0.5f, 0.5f);
 			ui->label("Label");
@@ -361,6 +382,10 @@ public:
 			}
 		}
 
+		if (key_just_pressed(key_f2)) {
+			profiler::write_trace("trace.json");
+		}
+
 		if (key_just_pressed(key_escape)) {
 			unlock_mouse();
 			camera_active = false;
@@ -372,11 +397,9 @@ public:
 			lock_mouse();
 		}
 
-		auto& t = monkey2.get<Transform>();
-		t.m = m4f::rotate(m4f::identity(), rot, v3f(0.0f, 1.0f, 0.0f));
+		monkey2.set(Transform { m4f::rotate(m4f::identity(), rot, v3f(0.0f, 1.0f, 0.0f)) });
 
-		auto& lt = blue_light.get<Transform>();
-		lt.m = m4f::translate(m4f::identity(), v3f((f32)cos(time * 2.0f), -1.0f, (f32)sin(time * 2.0f)));
+		blue_light.set(Transform { m4f::translate(m4f::identity(), v3f((f32)cos(time * 2.0f), -1.0f, (f32)sin(time * 2.0f))) });
 
 		renderer->draw(&world, camera);
 
@@ -395,6 +418,8 @@ public:
 	}
 
 	void on_deinit() override {
+		frame_times.print();
+
 		delete ui;
 		delete renderer;
 		delete monkey;
@@ -405,9 +430,10 @@ public:
 		delete shaders.lit;
 		delete shaders.tonemap;
 		delete shaders.bright_extract;
-		delete shaders.blur_v;
-		delete shaders.blur_h;
+		delete shaders.bloom_downsample;
+		delete shaders.bloom_upsample;
 		delete shaders.composite;
+		delete shaders.tonemap_composite;
 		delete shaders.shadowmap;
 		delete shaders.lighting;
 		delete renderer2d;
@@ -2,11 +2,14 @@ md shaders\obj
 md res\shaders
 
 lua54 shaders\compiler.lua shaders/src/lit.glsl shaders/obj/ res/shaders/
+lua54 shaders\compiler.lua shaders/src/lit.glsl shaders/obj/ res/shaders/ compact_gbuffer
 lua54 shaders\compiler.lua shaders/src/shadowmap.glsl shaders/obj/ res/shaders/
 lua54 shaders\compiler.lua shaders/src/tonemap.glsl shaders/obj/ res/shaders/
 lua54 shaders\compiler.lua shaders/src/bright_extract.glsl shaders/obj/ res/shaders/
-lua54 shaders\compiler.lua shaders/src/blur_v.glsl shaders/obj/ res/shaders/
-lua54 shaders\compiler.lua shaders/src/blur_h.glsl shaders/obj/ res/shaders/
+lua54 shaders\compiler.lua shaders/src/bloom_downsample.glsl shaders/obj/ res/shaders/
+lua54 shaders\compiler.lua shaders/src/bloom_upsample.glsl shaders/obj/ res/shaders/
 lua54 shaders\compiler.lua shaders/src/2d.glsl shaders/obj/ res/shaders/
 lua54 shaders\compiler.lua shaders/src/composite.glsl shaders/obj/ res/shaders/
+lua54 shaders\compiler.lua shaders/src/tonemap_composite.glsl shaders/obj/ res/shaders/
 lua54 shaders\compiler.lua shaders/src/lighting.glsl shaders/obj/ res/shaders/
+lua54 shaders\compiler.lua shaders/src/lighting.glsl shaders/obj/ res/shaders/ compact_gbuffer
@@ -4,12 +4,23 @@
 -- and invokes a call to glslc for each shader.
 --
 -- Usage:
--- 	compiler.lua file intdir outdir
+-- 	compiler.lua file intdir outdir [variant]
 --
 -- intdir is where the intermediate .vert and .frag files are
 -- created.
 --
 -- outdir is where the final .spv files are created.
+--
+-- variant, if given, is defined in upper case for the shader
+-- to #ifdef on, and is appended to the output names. For
+-- example, lit.glsl with the variant compact_gbuffer defines
+-- COMPACT_GBUFFER and creates lit_compact_gbuffer.vert.spv.
+
+local variant = arg[4]
+local define_string = ""
+if variant ~= nil then
+	define_string = "#define " .. string.upper(variant) .. "\n"
+end
 
 local line_number = 1
 local vertex = ""
@@ -24,7 +35,7 @@ for line in io.lines(arg[1]) do
 
 	if line == "#begin VERTEX" then
 		if #vertex == 0 then
-			vertex = version_string .. "\n"
+			vertex = version_string .. "\n" .. define_string
 		end
 
 		vertex = vertex .. "#line " .. tostring(line_number + 1) .. " \"" .. arg[1] .. "\"\n"
@@ -35,7 +46,7 @@ for line in io.lines(arg[1]) do
 
 	if line == "#begin FRAGMENT" then
 		if #fragment == 0 then
-			fragment = version_string .. "\n"
+			fragment = version_string .. "\n" .. define_string
 		end
 
 		fragment = fragment .. "#line " .. tostring(line_number + 1) .. " \"" .. arg[1] .. "\"\n"
@@ -97,8 +108,13 @@ if string.sub(outdir, #outdir - 1, #outdir) == "/" then
 	outdir = outdir .. "/"
 end
 
-local intpath_v = intdir .. string.gsub(arg[1], "/", "_") .. ".cint.vert"
-local intpath_f = intdir .. string.gsub(arg[1], "/", "_") .. ".cint.frag"
+local suffix = ""
+if variant ~= nil then
+	suffix = "_" .. variant
+end
+
+local intpath_v = intdir .. string.gsub(arg[1], "/", "_") .. suffix .. ".cint.vert"
+local intpath_f = intdir .. string.gsub(arg[1], "/", "_") .. suffix .. ".cint.frag"
 
 local out_i_v_f = io.open(intpath_v, "w")
 io.output(out_i_v_f)
@@ -110,8 +126,8 @@ io.output(out_i_f_f)
 io.write(fragment)
 io.close(out_i_f_f)
 
-local out_name_v = string.gsub(string.match(arg[1], ".*/(.*)"), ".glsl", ".vert")
-local out_name_f = string.gsub(string.match(arg[1], ".*/(.*)"), ".glsl", ".frag")
+local out_name_v = string.gsub(string.match(arg[1], ".*/(.*)"), ".glsl", suffix .. ".vert")
+local out_name_f = string.gsub(string.match(arg[1], ".*/(.*)"), ".glsl", suffix .. ".frag")
 
 io.popen("glslc " .. intpath_v .. " -o " .. outdir .. out_name_v .. ".spv")
 io.popen("glslc " .. intpath_f .. " -o " .. outdir .. out_name_f .. ".spv")
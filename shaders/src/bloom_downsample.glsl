@@ -0,0 +1,31 @@
+#version 450
+
+#begin VERTEX
+
+#include "pp_vertex.glsl"
+
+#end VERTEX
+
+#begin FRAGMENT
+
+#include "pp_common.glsl"
+#include "pp_config.glsl"
+
+layout (set = 1, binding = 0) uniform sampler2D input_texture;
+
+/* Downsampling half of the dual filter from "Bandwidth-Efficient Rendering"
+ * (Marius Bjorge, SIGGRAPH 2015). The input is twice the size of the
+ * output and sampled bilinearly, so the five taps cover a 4x4 block. */
+void main() {
+	vec2 offset = config.bloom_blur_intensity / vec2(textureSize(input_texture, 0));
+
+	vec4 sum = texture(input_texture, fs_in.uv) * 4.0;
+	sum += texture(input_texture, fs_in.uv + vec2(-offset.x, -offset.y));
+	sum += texture(input_texture, fs_in.uv + vec2( offset.x, -offset.y));
+	sum += texture(input_texture, fs_in.uv + vec2(-offset.x,  offset.y));
+	sum += texture(input_texture, fs_in.uv + vec2( offset.x,  offset.y));
+
+	color = sum / 8.0;
+}
+
+#end FRAGMENT
@@ -0,0 +1,34 @@
+#version 450
+
+#begin VERTEX
+
+#include "pp_vertex.glsl"
+
+#end VERTEX
+
+#begin FRAGMENT
+
+#include "pp_common.glsl"
+#include "pp_config.glsl"
+
+layout (set = 1, binding = 0) uniform sampler2D input_texture;
+
+/* Upsampling half of the dual filter: a tent over the half size input,
+ * with the diagonal taps weighted twice. */
+void main() {
+	vec2 offset = config.bloom_blur_intensity / vec2(textureSize(input_texture, 0));
+
+	vec4 sum = vec4(0.0);
+	sum += texture(input_texture, fs_in.uv + vec2(-offset.x * 2.0, 0.0));
+	sum += texture(input_texture, fs_in.uv + vec2( offset.x * 2.0, 0.0));
+	sum += texture(input_texture, fs_in.uv + vec2(0.0, -offset.y * 2.0));
+	sum += texture(input_texture, fs_in.uv + vec2(0.0,  offset.y * 2.0));
+	sum += texture(input_texture, fs_in.uv + vec2(-offset.x, -offset.y)) * 2.0;
+	sum += texture(input_texture, fs_in.uv + vec2( offset.x, -offset.y)) * 2.0;
+	sum += texture(input_texture, fs_in.uv + vec2(-offset.x,  offset.y)) * 2.0;
+	sum += texture(input_texture, fs_in.uv + vec2( offset.x,  offset.y)) * 2.0;
+
+	color = sum / 12.0;
+}
+
+#end FRAGMENT
@@ -11,12 +11,21 @@
 #include "pp_common.glsl"
 #include "pp_config.glsl"
 #include "material.glsl"
+#include "gbuffer.glsl"
 
+/* Must match Renderer3D::GBufferLayout. */
 layout (set = 1, binding = 0) uniform sampler2D in_color;
 layout (set = 1, binding = 1) uniform sampler2D normal;
+#ifdef COMPACT_GBUFFER
+layout (set = 1, binding = 2) uniform sampler2D scene_depth;
+#else
 layout (set = 1, binding = 2) uniform sampler2D position;
+#endif
 
-#define max_point_lights 256
+/* Must match the definitions in renderer.hpp. */
+#define cluster_grid_x 16
+#define cluster_grid_y 9
+#define cluster_grid_z 24
 
 struct PointLight {
 	vec3 diffuse, specular;
@@ -24,11 +33,31 @@ struct PointLight {
 	float intensity, range;
 };
 
+struct Cluster {
+	uint offset;
+	uint count;
+};
+
 layout (binding = 1) uniform LightingData {
+	mat4 view;
+	mat4 inv_view_projection;
 	int point_light_count;
-	PointLight point_lights[max_point_lights];
+	float cluster_z_scale;
+	float cluster_z_bias;
 } lights;
 
+layout (std430, binding = 2) readonly buffer PointLights {
+	PointLight point_lights[];
+};
+
+layout (std430, binding = 3) readonly buffer Clusters {
+	Cluster clusters[];
+};
+
+layout (std430, binding = 4) readonly buffer ClusterLightIndices {
+	uint cluster_light_indices[];
+};
+
 layout (push_constant) uniform PushData {
 	Material material;
 	float use_diffuse_map;
@@ -41,7 +70,10 @@ vec3 compute_point_light(vec3 n, vec3 world_pos, vec3 view_dir, PointLight light
 
 	float dist = length(light.position - world_pos);
 
-	float attenuation = 1.0 / (pow((dist / light.range) * 5.0, 2.0) + 1);
+	/* Windowed so that the light reaches zero at its range, which is
+	 * what the clusters are built from. */
+	float window = clamp(1.0 - pow(dist / light.range, 4.0), 0.0, 1.0);
+	float attenuation = (window * window) / (pow((dist / light.range) * 5.0, 2.0) + 1);
 
 	vec3 diffuse =
 		attenuation *
@@ -63,13 +95,31 @@ vec3 compute_point_light(vec3 n, vec3 world_pos, vec3 view_dir, PointLight light
 void main() {
 	vec3 result = vec3(0.0);
 
+#ifdef COMPACT_GBUFFER
+	float scene_z = texture(scene_depth, fs_in.uv).r;
+
+	vec4 world_pos_h = lights.inv_view_projection * vec4(fs_in.uv * 2.0 - 1.0, scene_z, 1.0);
+	vec3 world_pos = world_pos_h.xyz / world_pos_h.w;
+	vec3 world_normal = scene_z < 1.0 ? decode_normal(texture(normal, fs_in.uv).rg) : vec3(0.0);
+#else
 	vec3 world_pos = texture(position, fs_in.uv).rgb;
 	vec3 world_normal = texture(normal, fs_in.uv).rgb;
+#endif
 
 	vec3 view_dir = normalize(config.camera_pos - world_pos);
 
-	for (int i = 0; i < lights.point_light_count; i++) {
-		result += compute_point_light(world_normal, world_pos, view_dir, lights.point_lights[i]);
+	float depth = -(lights.view * vec4(world_pos, 1.0)).z;
+
+	uvec3 cluster_pos = uvec3(
+		min(uint(fs_in.uv.x * cluster_grid_x), uint(cluster_grid_x - 1)),
+		min(uint(fs_in.uv.y * cluster_grid_y), uint(cluster_grid_y - 1)),
+		uint(clamp(log(max(depth, 0.0001)) * lights.cluster_z_scale + lights.cluster_z_bias, 0.0, float(cluster_grid_z - 1))));
+
+	Cluster cluster = clusters[(cluster_pos.z * cluster_grid_y + cluster_pos.y) * cluster_grid_x + cluster_pos.x];
+
+	for (uint i = 0; i < cluster.count; i++) {
+		uint light_index = cluster_light_indices[cluster.offset + i];
+		result += compute_point_light(world_normal, world_pos, view_dir, point_lights[light_index]);
 	}
 
 	/* To make sure that the clear colour doesn't get lit. */
@@ -11,7 +11,6 @@ layout (location = 4) in vec3 bitangent;
 layout (binding = 0) uniform VertexBuffer {
 	mat4 view;
 	mat4 projection;
-	mat4 sun_matrix;
 } data;
 
 layout (push_constant) uniform PushData {
@@ -22,7 +21,7 @@ layout (location = 0) out VertexOut {
 	mat3 tbn;
 	vec3 world_pos;
 	vec2 uv;
-	vec4 sun_pos;
+	float view_depth;
 } vs_out;
 
 void main() {
@@ -34,9 +33,11 @@ void main() {
 	vec3 b = normalize(vec3(push_data.transform * vec4(bitangent, 0.0)));
 
 	vs_out.tbn = mat3(t, b, n);
-	vs_out.sun_pos = data.sun_matrix * vec4(vs_out.world_pos, 1.0);
 
 	gl_Position = data.projection * data.view * vec4(vs_out.world_pos, 1.0);
+
+	/* With a perspective projection, w is the distance along the view axis. */
+	vs_out.view_depth = gl_Position.w;
 }
 
 #end VERTEX
@@ -47,6 +48,15 @@ void main() {
  * sample the depth buffer to determine blockers. */
 #include "poisson_disk.glsl"
 #include "material.glsl"
+#include "gbuffer.glsl"
+
+/* Must match the definitions in renderer.hpp. */
+#define shadow_cascade_count 4
+
+#define shadow_quality_hard      0
+#define shadow_quality_pcf       1
+#define shadow_quality_pcss_low  2
+#define shadow_quality_pcss_high 3
 
 struct DirectionalLight {
 	float intensity;
@@ -58,8 +68,15 @@ struct DirectionalLight {
 };
 
 layout (location = 0) out vec4 out_color;
+
+/* Must match Renderer3D::GBufferLayout; the compact layout has no
+ * positions, as the lighting pass finds them from depth. */
+#ifdef COMPACT_GBUFFER
+layout (location = 1) out vec2 out_normal;
+#else
 layout (location = 1) out vec4 out_normal;
 layout (location = 2) out vec4 out_position;
+#endif
 
 layout (binding = 1) uniform FragmentData {
 	vec3 camera_pos;
@@ -71,15 +88,20 @@ layout (binding = 1) uniform FragmentData {
 
 	int blocker_search_sample_count;
 	int pcf_sample_count;
+	int shadow_quality;
 
 	DirectionalLight sun;
+
+	vec4 cascade_splits;
+	vec4 cascade_scales;
+	mat4 sun_matrices[shadow_cascade_count];
 } data;
 
 layout (location = 0) in VertexOut {
 	mat3 tbn;
 	vec3 world_pos;
 	vec2 uv;
-	vec4 sun_pos;
+	float view_depth;
 } fs_in;
 
 layout (push_constant) uniform PushData {
@@ -92,12 +114,18 @@ layout (push_constant) uniform PushData {
 layout (set = 1, binding = 0) uniform sampler2D diffuse_map;
 layout (set = 1, binding = 1) uniform sampler2D normal_map;
 
-layout (set = 0, binding = 2) uniform sampler2D blockermap;
-layout (set = 0, binding = 3) uniform sampler2DShadow shadowmap;
+layout (set = 0, binding = 2) uniform sampler2D blockermap0;
+layout (set = 0, binding = 3) uniform sampler2D blockermap1;
+layout (set = 0, binding = 4) uniform sampler2D blockermap2;
+layout (set = 0, binding = 5) uniform sampler2D blockermap3;
+layout (set = 0, binding = 6) uniform sampler2DShadow shadowmap0;
+layout (set = 0, binding = 7) uniform sampler2DShadow shadowmap1;
+layout (set = 0, binding = 8) uniform sampler2DShadow shadowmap2;
+layout (set = 0, binding = 9) uniform sampler2DShadow shadowmap3;
 
 /* Find the average depth of the light blockers. */
-float blocker_dist(vec3 coords, float size, float bias) {
-	int blocker_count = 0;
+float blocker_dist(sampler2D blockermap, vec3 coords, float size, float bias, out int blocker_count) {
+	blocker_count = 0;
 	float r = 0.0;
 	/*                                                  max avoids a divide-by-zero. */
 	float width = size * (coords.z - data.near_plane) / max(1.0f, data.camera_pos.z);
@@ -117,7 +145,7 @@ float blocker_dist(vec3 coords, float size, float bias) {
 	}
 }
 
-float pcf(vec3 coords, float radius, float bias) {
+float pcf(sampler2DShadow shadowmap, vec3 coords, float radius, float bias) {
 	float r = 0.0;
 
 	for (int i = 0; i < data.pcf_sample_count; i++) {
@@ -127,6 +155,76 @@ float pcf(vec3 coords, float radius, float bias) {
 	return r / float(data.pcf_sample_count);
 }
 
+/* Fixed 3x3 kernel, for when PCSS is too expensive. The comparison
+ * sampler filters each tap between four texels. */
+float pcf_fixed(sampler2DShadow shadowmap, vec3 coords, float bias) {
+	vec2 texel_size = 1.0 / vec2(textureSize(shadowmap, 0));
+
+	float r = 0.0;
+	for (int y = -1; y <= 1; y++) {
+		for (int x = -1; x <= 1; x++) {
+			r += texture(shadowmap, vec3(coords.xy + vec2(x, y) * texel_size, coords.z - bias));
+		}
+	}
+
+	return r / 9.0;
+}
+
+float cascade_shadow(sampler2D blockermap, sampler2DShadow shadowmap, vec3 coords, float light_size) {
+	if (data.shadow_quality == shadow_quality_hard) {
+		return texture(shadowmap, vec3(coords.xy, coords.z - data.sun.bias));
+	} else if (data.shadow_quality == shadow_quality_pcf) {
+		return pcf_fixed(shadowmap, coords, data.sun.bias);
+	}
+
+	int blocker_count;
+	float blocker = blocker_dist(blockermap, coords, light_size, data.sun.bias, blocker_count);
+
+	/* Nothing in the way: fully lit. Everything in the way: in the
+	 * umbra, where filtering wouldn't change the result. Either way
+	 * the PCF taps can be skipped. */
+	if (blocker_count == 0) {
+		return 1.0;
+	} else if (blocker_count == data.blocker_search_sample_count) {
+		return 0.0;
+	}
+
+	/* This formula to estimate the penumbra size from the
+	 * average of blockers comes from:
+	 * https://developer.download.nvidia.com/shaderlibrary/docs/shadow_PCSS.pdf */
+	float penumbra = ((coords.z - blocker) * light_size) / blocker;
+
+	float pcf_radius = penumbra * light_size * data.near_plane / coords.z;
+	return pcf(shadowmap, coords, pcf_radius, data.sun.bias);
+}
+
+float sun_shadow(float light_size) {
+	int cascade = 0;
+	while (cascade < shadow_cascade_count && fs_in.view_depth > data.cascade_splits[cascade]) {
+		cascade++;
+	}
+
+	/* Past the shadow distance. */
+	if (cascade == shadow_cascade_count) {
+		return 1.0;
+	}
+
+	vec4 sun_pos = data.sun_matrices[cascade] * vec4(fs_in.world_pos, 1.0);
+	vec3 coords = sun_pos.xyz / sun_pos.w;
+	coords.xy = coords.xy * 0.5 + 0.5;
+
+	/* Keep the penumbrae the same size in world space, whichever
+	 * cascade they fall in. */
+	light_size *= data.cascade_scales[cascade];
+
+	switch (cascade) {
+		case 0: return cascade_shadow(blockermap0, shadowmap0, coords, light_size);
+		case 1: return cascade_shadow(blockermap1, shadowmap1, coords, light_size);
+		case 2: return cascade_shadow(blockermap2, shadowmap2, coords, light_size);
+		default: return cascade_shadow(blockermap3, shadowmap3, coords, light_size);
+	}
+}
+
 vec3 compute_directional_light(vec3 normal, vec3 view_dir, DirectionalLight light) {
 	vec3 light_dir = normalize(light.direction);
 	vec3 reflect_dir = reflect(-light_dir, normal);
@@ -143,28 +241,7 @@ vec3 compute_directional_light(vec3 normal, vec3 view_dir, DirectionalLight ligh
 		push_data.material.specular * 
 		pow(max(dot(view_dir, reflect_dir), 0.0), 32.0);
 
-	float light_size = light.softness;
-
-	/* Shadow calculation. */
-	vec3 coords = fs_in.sun_pos.xyz / fs_in.sun_pos.w;
-	coords.xy = coords.xy * 0.5 + 0.5;
-
-	float blocker = blocker_dist(coords, light_size, data.sun.bias);
-	if (blocker == -1.0) {
-		return diffuse + specular;
-	}
-
-	/* This formula to estimate the penumbra size from the
-	 * average of blockers comes from:
-	 * https://developer.download.nvidia.com/shaderlibrary/docs/shadow_PCSS.pdf */
-	float penumbra = ((coords.z - blocker) * light_size) / blocker;
-
-	float texel_size = 1.0 / textureSize(shadowmap, 0).x;
-
-	float pcf_radius = penumbra * light_size * data.near_plane / coords.z;
-	float shadow = pcf(coords, pcf_radius, data.sun.bias);
-
-	return (shadow) * (diffuse + specular);
+	return sun_shadow(light.softness) * (diffuse + specular);
 }
 
 void main() {
@@ -189,7 +266,11 @@ void main() {
 	}
 
 	out_color = texture_color * vec4(lighting_result, 1.0);
+#ifdef COMPACT_GBUFFER
+	out_normal = encode_normal(normal);
+#else
 	out_normal = vec4(normal, 1.0);
 	out_position = vec4(fs_in.world_pos, 1.0);
+#endif
 }
 #end FRAGMENT
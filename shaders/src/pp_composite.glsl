@@ -0,0 +1,4 @@
+/* Needs pp_config.glsl. */
+vec4 composite(vec4 scene, vec4 bloom) {
+	return scene + bloom * config.bloom_intensity;
+}
@@ -0,0 +1,13 @@
+/* From: https://knarkowicz.wordpress.com/2016/01/06/aces-filmic-tone-mapping-curve/ */
+vec3 aces(vec3 x) {
+	float a = 2.51f;
+	float b = 0.03f;
+	float c = 2.43f;
+	float d = 0.59f;
+	float e = 0.14f;
+	return clamp((x * (a * x + b)) / (x * (c * x + d) + e), 0.0, 1.0);
+}
+
+vec4 tonemap(vec4 hdr) {
+	return vec4(aces(hdr.rgb), hdr.a);
+}
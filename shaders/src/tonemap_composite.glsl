@@ -0,0 +1,27 @@
+#version 450
+
+/* tonemap.glsl followed by composite.glsl, for when the render graph fuses
+ * the two passes. The tonemapped scene is never written out; the bindings
+ * are composite's, with the tonemapped scene replaced by tonemap's input. */
+
+#begin VERTEX
+
+#include "pp_vertex.glsl"
+
+#end VERTEX
+
+#begin FRAGMENT
+
+#include "pp_common.glsl"
+#include "pp_config.glsl"
+#include "pp_tonemap.glsl"
+#include "pp_composite.glsl"
+
+layout (set = 1, binding = 0) uniform sampler2D input_texture;
+layout (set = 1, binding = 1) uniform sampler2D bloom;
+
+void main() {
+	color = composite(tonemap(texture(input_texture, fs_in.uv)), texture(bloom, fs_in.uv));
+}
+
+#end FRAGMENT
@@ -56,6 +56,36 @@ ecs::i32 main() {
 		std::cout << tag.name << ": " <<  trans.x << ", " << trans.y << "\n";
 	}
 }
+
+== Change Tracking ==
+Every component carries the world tick at which it was added and the
+tick at which it was last marked as changed. A system remembers the tick
+it last ran at and filters its views with it, so that it only visits the
+entities that need work:
+
+	ecs::u64 last_tick = 0;
+
+	world.add_tick_reader(&last_tick);
+
+	void system(ecs::World& world) {
+		for (auto view = world.new_view<Transform>().changed<Transform>(last_tick); view.valid(); view.next()) {
+			...
+		}
+
+		world.each_removed<Transform>(last_tick, [](ecs::Entity_Handle e) {
+			...
+		});
+
+		last_tick = world.advance_tick();
+	}
+
+Removals are kept until nothing can still see them. Registered readers let
+advance_tick drop the ones older than every reader's last tick; without any,
+call world.clear_removed() with the oldest tick still in use, or the removal
+lists grow forever.
+
+Writes through get() are not tracked; call mark_changed() on the entity
+or the view after modifying a component, or use Entity::set().
 */
 
 #pragma once
@@ -90,6 +120,14 @@ namespace ecs {
 	using Component_Create_Func = std::function<void(World&, const Entity&)>;
 	using Component_Destroy_Func = std::function<void(World&, const Entity&)>;
 
+	/* Called on each element of a registered component when writing or
+	 * reading a snapshot, to turn pointers into something that survives
+	 * the round trip and back again. */
+	using Component_Fixup_Func = std::function<void(World&, void*)>;
+
+	static const u32 snapshot_magic = 0x57534345; /* "ECSW" */
+	static const u32 snapshot_version = 1;
+
 	namespace internal {
 		Entity_Version get_entity_version(Entity_Handle e);
 		Entity_ID get_entity_id(Entity_Handle e);
@@ -109,6 +147,11 @@ namespace ecs {
 			}
 		}
 
+		struct Removal {
+			Entity_Handle entity;
+			u64 tick;
+		};
+
 		class Component_Pool {
 		public:
 			i64* sparse = nullptr;
@@ -118,6 +161,14 @@ namespace ecs {
 			u64 dense_count = 0;
 			u64 dense_capacity = 0;
 
+			/* Parallel to dense. */
+			u64* added_ticks = nullptr;
+			u64* changed_ticks = nullptr;
+
+			Removal* removed = nullptr;
+			u64 removed_count = 0;
+			u64 removed_capacity = 0;
+
 			u8* data = nullptr;
 			u64 count = 0;
 			u64 capacity = 0;
@@ -130,6 +181,12 @@ namespace ecs {
 			Component_Create_Func on_create;
 			Component_Destroy_Func on_destroy;
 
+			/* Set by World::register_component. Only pools with a
+			 * stable ID end up in snapshots. */
+			u64 stable_id = 0;
+			Component_Fixup_Func on_save;
+			Component_Fixup_Func on_load;
+
 			void init(World* w, u64 type_id, u64 el_size) {
 				element_size = el_size;
 				id = type_id;
@@ -155,8 +212,20 @@ namespace ecs {
 				return get_by_idx(sparse_idx(e));
 			}
 
+			u64 added_tick(Entity_Handle e) const {
+				return added_ticks[sparse_idx(e)];
+			}
+
+			u64 changed_tick(Entity_Handle e) const {
+				return changed_ticks[sparse_idx(e)];
+			}
+
+			void mark_changed(Entity_Handle e);
+
 			void* add(Entity_Handle e);
 			void remove(Entity_Handle e);
+
+			void clear_removed(u64 up_to);
 		};
 	}
 
@@ -166,6 +235,17 @@ namespace ecs {
 
 		friend class World;
 	private:
+		enum class Filter_Type {
+			ADDED,
+			CHANGED
+		};
+
+		struct Filter {
+			Filter_Type type;
+			internal::Component_Pool* pool;
+			u64 since;
+		};
+
 		u64 to_pool[max];
 		internal::Component_Pool* pools[max];
 		u64 pool_count = 0;
@@ -174,6 +254,9 @@ namespace ecs {
 		Entity_Handle entity = null_handle;
 		World* world = nullptr;
 
+		Filter filters[max];
+		u64 filter_count = 0;
+
 		bool contains(Entity_Handle handle) {
 			for (u64 i = 0; i < pool_count; i++) {
 				if (!pools[i]->has(handle)) {
@@ -181,9 +264,27 @@ namespace ecs {
 				}
 			}
 
+			for (u64 i = 0; i < filter_count; i++) {
+				auto& filter = filters[i];
+
+				if (!filter.pool->has(handle)) {
+					return false;
+				}
+
+				const u64 tick = filter.type == Filter_Type::ADDED ?
+					filter.pool->added_tick(handle) :
+					filter.pool->changed_tick(handle);
+
+				if (tick <= filter.since) {
+					return false;
+				}
+			}
+
 			return true;
 		}
 
+		View& add_filter(Filter_Type type, u64 id, u64 since);
+
 		u64 get_idx(u64 id) {
 			for (u64 i = 0; i < pool_count; i++) {
 				if (to_pool[i] == id) {
@@ -212,6 +313,25 @@ namespace ecs {
 			return *(T*)pools[get_idx(internal::get_component_id<T>())]->get(entity);
 		}
 
+		template <typename T>
+		void mark_changed() {
+			pools[get_idx(internal::get_component_id<T>())]->mark_changed(entity);
+		}
+
+		/* Filters restrict the view to entities whose component T was
+		 * added or changed after the tick `since'. The component doesn't
+		 * have to be one of the view's types, but entities without it
+		 * are skipped. */
+		template <typename T>
+		View& added(u64 since) {
+			return add_filter(Filter_Type::ADDED, internal::get_component_id<T>(), since);
+		}
+
+		template <typename T>
+		View& changed(u64 since) {
+			return add_filter(Filter_Type::CHANGED, internal::get_component_id<T>(), since);
+		}
+
 		Entity get_entity() const;
 	};
 
@@ -251,6 +371,22 @@ namespace ecs {
 
 		i64 iteration_depth = 0;
 
+		u64 tick = 1;
+
+		static const u64 max_tick_readers = 32;
+		const u64* tick_readers[max_tick_readers];
+		u64 tick_reader_count = 0;
+
+		internal::Component_Pool* find_pool(u64 id) {
+			for (u64 i = 0; i < pool_count; i++) {
+				if (pools[i].id == id) {
+					return pools + i;
+				}
+			}
+
+			return nullptr;
+		}
+
 		template <typename T>
 		internal::Component_Pool& get_pool() {
 			u64 id = internal::get_component_id<T>();
@@ -413,6 +549,73 @@ namespace ecs {
 			return alive_count;
 		}
 
+		/* Adding, changing and removing components stamps them with
+		 * the current tick. Ticks start at one, so a `since' of zero
+		 * matches every component. */
+		u64 get_tick() const {
+			return tick;
+		}
+
+		/* Returns the current tick and moves on to the next one. Store the
+		 * result and pass it as `since' to the next round of queries to pick
+		 * up everything that happened after this call. */
+		u64 advance_tick() {
+			if (tick_reader_count > 0) {
+				u64 oldest = *tick_readers[0];
+				for (u64 i = 1; i < tick_reader_count; i++) {
+					if (*tick_readers[i] < oldest) {
+						oldest = *tick_readers[i];
+					}
+				}
+
+				clear_removed(oldest);
+			}
+
+			return tick++;
+		}
+
+		/* Registers the `last_tick' of a system that reads removals, so
+		 * that advance_tick can forget about the ones that every registered
+		 * reader has already seen. The pointer must stay valid until it is
+		 * passed to remove_tick_reader. */
+		void add_tick_reader(const u64* last_tick) {
+			assert(tick_reader_count < max_tick_readers && "Too many tick readers.");
+			tick_readers[tick_reader_count++] = last_tick;
+		}
+
+		void remove_tick_reader(const u64* last_tick) {
+			for (u64 i = 0; i < tick_reader_count; i++) {
+				if (tick_readers[i] == last_tick) {
+					tick_readers[i] = tick_readers[--tick_reader_count];
+					return;
+				}
+			}
+		}
+
+		/* Calls `f' for every entity that lost its T component after
+		 * the tick `since', including entities that were destroyed. */
+		template <typename T>
+		void each_removed(u64 since, const std::function<void(Entity_Handle)>& f) {
+			auto pool = find_pool(internal::get_component_id<T>());
+			if (!pool) { return; }
+
+			for (u64 i = 0; i < pool->removed_count; i++) {
+				if (pool->removed[i].tick > since) {
+					f(pool->removed[i].entity);
+				}
+			}
+		}
+
+		/* Forgets about removals that happened at or before `up_to'.
+		 * Should be called with the oldest tick that any system still
+		 * cares about to stop the removal lists from growing forever.
+		 * advance_tick does this by itself once any readers are registered. */
+		void clear_removed(u64 up_to) {
+			for (u64 i = 0; i < pool_count; i++) {
+				pools[i].clear_removed(up_to);
+			}
+		}
+
 		template <typename T>
 		void set_create_func(Component_Create_Func f) {
 			get_pool<T>().on_create = f;
@@ -423,6 +626,33 @@ namespace ecs {
 			get_pool<T>().on_destroy = f;
 		}
 
+		/* Registers T for snapshots. `stable_id' identifies the component
+		 * in the snapshot and must not change between builds, unlike the
+		 * type hash that is used at run-time. T has to be trivially copyable
+		 * once the fixup functions have been applied. */
+		template <typename T>
+		void register_component(u64 stable_id, Component_Fixup_Func on_save = nullptr, Component_Fixup_Func on_load = nullptr) {
+			assert(stable_id != 0 && "Zero is not a valid stable component ID.");
+
+			auto& pool = get_pool<T>();
+			pool.stable_id = stable_id;
+			pool.on_save = on_save;
+			pool.on_load = on_load;
+		}
+
+		/* Snapshots store the entity table as-is, followed by the dense
+		 * arrays of every registered pool, so loading one is a handful of
+		 * memcpys rather than a new_entity/add call per component.
+		 *
+		 * Component create functions are not called on load. */
+		u64 snapshot_size() const;
+		void write_snapshot(u8* dst);
+
+		/* Replaces the contents of the world, which mustn't be iterated
+		 * and mustn't have any living entities. Returns false if the
+		 * snapshot is malformed or doesn't match the registered components. */
+		bool read_snapshot(const u8* src, u64 size);
+
 		Entity at(u64 i);
 
 		Entity new_entity();
@@ -908,6 +1138,46 @@ namespace ecs {
 			world->get_pool<T>().remove(handle);
 		}
 
+		/* Overwrites the component and marks it as changed. */
+		template <typename T>
+		T& set(T c) {
+			assert(valid() && "Invalid entity.");
+			assert(has<T>() && "Entity doesn't have the requested component.");
+
+			auto& pool = world->get_pool<T>();
+
+			T* p = (T*)pool.get(handle);
+			*p = c;
+
+			pool.mark_changed(handle);
+
+			return *p;
+		}
+
+		template <typename T>
+		void mark_changed() {
+			assert(valid() && "Invalid entity.");
+			assert(has<T>() && "Entity doesn't have the requested component.");
+
+			world->get_pool<T>().mark_changed(handle);
+		}
+
+		template <typename T>
+		u64 added_tick() const {
+			assert(valid() && "Invalid entity.");
+			assert(has<T>() && "Entity doesn't have the requested component.");
+
+			return world->get_pool<T>().added_tick(handle);
+		}
+
+		template <typename T>
+		u64 changed_tick() const {
+			assert(valid() && "Invalid entity.");
+			assert(has<T>() && "Entity doesn't have the requested component.");
+
+			return world->get_pool<T>().changed_tick(handle);
+		}
+
 		bool operator==(const Entity& r) {
 			return handle == r.handle && world == r.world;
 		}
@@ -1013,25 +1283,52 @@ namespace ecs {
 			if (dense_count >= dense_capacity) {
 				u64 new_capacity = dense_capacity < 8 ? 8 : dense_capacity * 2;
 				Entity_Handle* new_alloc = new Entity_Handle[new_capacity];
+				u64* new_added = new u64[new_capacity];
+				u64* new_changed = new u64[new_capacity];
 				if (dense) {
 					mem_copy(new_alloc, dense, dense_capacity);
+					mem_copy(new_added, added_ticks, dense_capacity);
+					mem_copy(new_changed, changed_ticks, dense_capacity);
 
 					if (world->iteration_depth <= 0) {
 						delete[] dense;
+						delete[] added_ticks;
+						delete[] changed_ticks;
 					} else {
 						world->push_deletion(World::Delete_Type::ENTITY_HANDLE, dense);
+						world->push_deletion(World::Delete_Type::U64, added_ticks);
+						world->push_deletion(World::Delete_Type::U64, changed_ticks);
 					}
 				}
 
 				dense_capacity = new_capacity;
 				dense = new_alloc;
+				added_ticks = new_added;
+				changed_ticks = new_changed;
 			}
 
+			added_ticks[dense_count] = world->tick;
+			changed_ticks[dense_count] = world->tick;
 			dense[dense_count++] = e;
 
 			return new_el;
 		}
 
+		void Component_Pool::mark_changed(Entity_Handle e) {
+			changed_ticks[sparse_idx(e)] = world->tick;
+		}
+
+		void Component_Pool::clear_removed(u64 up_to) {
+			u64 kept = 0;
+			for (u64 i = 0; i < removed_count; i++) {
+				if (removed[i].tick > up_to) {
+					removed[kept++] = removed[i];
+				}
+			}
+
+			removed_count = kept;
+		}
+
 		void Component_Pool::remove(Entity_Handle e) {
 			if (on_destroy) {
 				on_destroy(*world, Entity(e, world));
@@ -1042,8 +1339,24 @@ namespace ecs {
 
 			sparse[get_entity_id(other)] = pos;
 			dense[pos] = other;
+			added_ticks[pos] = added_ticks[dense_count - 1];
+			changed_ticks[pos] = changed_ticks[dense_count - 1];
 			sparse[get_entity_id(e)] = -1;
 
+			if (removed_count >= removed_capacity) {
+				u64 new_capacity = removed_capacity < 8 ? 8 : removed_capacity * 2;
+				Removal* new_alloc = new Removal[new_capacity];
+				if (removed) {
+					mem_copy(new_alloc, removed, removed_capacity);
+					delete[] removed;
+				}
+
+				removed_capacity = new_capacity;
+				removed = new_alloc;
+			}
+
+			removed[removed_count++] = Removal { e, world->tick };
+
 			memmove(&data[pos * element_size], &data[(count - 1) * element_size], element_size);
 
 			dense_count--;
@@ -1060,6 +1373,9 @@ namespace ecs {
 			delete[] sparse;
 			delete[] dense;
 			delete[] data;
+			delete[] added_ticks;
+			delete[] changed_ticks;
+			delete[] removed;
 		}
 	}
 
@@ -1073,6 +1389,274 @@ namespace ecs {
 		}
 	}
 
+	namespace internal {
+		struct Snapshot_Header {
+			u32 magic;
+			u32 version;
+			u64 entity_count;
+			u64 alive_count;
+			u64 pool_count;
+			Entity_ID avail_id;
+			u32 padding;
+		};
+
+		struct Snapshot_Pool_Header {
+			u64 stable_id;
+			u64 element_size;
+			u64 count;
+		};
+	}
+
+	u64 World::snapshot_size() const {
+		u64 size = sizeof(internal::Snapshot_Header) + entity_count * sizeof(Entity_Handle);
+
+		for (u64 i = 0; i < pool_count; i++) {
+			auto& pool = pools[i];
+			if (pool.stable_id == 0) { continue; }
+
+			size += sizeof(internal::Snapshot_Pool_Header) +
+				pool.count * sizeof(Entity_Handle) +
+				pool.count * pool.element_size;
+		}
+
+		return size;
+	}
+
+	void World::write_snapshot(u8* dst) {
+		internal::Snapshot_Header header = {};
+		header.magic = snapshot_magic;
+		header.version = snapshot_version;
+		header.entity_count = entity_count;
+		header.alive_count = alive_count;
+		header.avail_id = avail_id;
+
+		for (u64 i = 0; i < pool_count; i++) {
+			if (pools[i].stable_id != 0) {
+				header.pool_count++;
+			}
+		}
+
+		memcpy(dst, &header, sizeof(header));
+		dst += sizeof(header);
+
+		memcpy(dst, entities, entity_count * sizeof(Entity_Handle));
+		dst += entity_count * sizeof(Entity_Handle);
+
+		for (u64 i = 0; i < pool_count; i++) {
+			auto& pool = pools[i];
+			if (pool.stable_id == 0) { continue; }
+
+			internal::Snapshot_Pool_Header ph = { pool.stable_id, pool.element_size, pool.count };
+			memcpy(dst, &ph, sizeof(ph));
+			dst += sizeof(ph);
+
+			memcpy(dst, pool.dense, pool.count * sizeof(Entity_Handle));
+			dst += pool.count * sizeof(Entity_Handle);
+
+			const u64 data_size = pool.count * pool.element_size;
+			memcpy(dst, pool.data, data_size);
+
+			if (pool.on_save) {
+				for (u64 ii = 0; ii < pool.count; ii++) {
+					pool.on_save(*this, dst + ii * pool.element_size);
+				}
+			}
+
+			dst += data_size;
+		}
+	}
+
+	namespace internal {
+		/* a * b, unless it overflows. */
+		inline bool checked_mul(u64 a, u64 b, u64* r) {
+			if (b != 0 && a > UINT64_MAX / b) { return false; }
+
+			*r = a * b;
+			return true;
+		}
+
+		/* Snapshots aren't necessarily aligned, so handles are copied out. */
+		inline Entity_Handle read_handle(const u8* src, u64 i) {
+			Entity_Handle e;
+			memcpy(&e, src + i * sizeof(Entity_Handle), sizeof(e));
+			return e;
+		}
+	}
+
+	bool World::read_snapshot(const u8* src, u64 size) {
+		assert(iteration_depth <= 0 && "Can't load a snapshot while iterating.");
+		assert(alive_count == 0 && "Can only load a snapshot into an empty world.");
+
+		/* The whole snapshot is checked before anything is replaced, so
+		 * that bad input leaves the world as it was. */
+		const u8* end = src + size;
+
+		internal::Snapshot_Header header;
+		if (size < sizeof(header)) { return false; }
+
+		memcpy(&header, src, sizeof(header));
+		src += sizeof(header);
+
+		if (header.magic != snapshot_magic || header.version != snapshot_version) {
+			return false;
+		}
+
+		if (header.entity_count > (u64)null_entity_id || header.alive_count > header.entity_count) {
+			return false;
+		}
+
+		u64 entities_size;
+		if (!internal::checked_mul(header.entity_count, sizeof(Entity_Handle), &entities_size) ||
+			(u64)(end - src) < entities_size) {
+			return false;
+		}
+
+		const u8* entities_src = src;
+		src += entities_size;
+
+		/* The free list must hold exactly the entities that aren't alive,
+		 * with no cycles. */
+		const u64 free_count = header.entity_count - header.alive_count;
+		u64 walked = 0;
+		for (Entity_ID id = header.avail_id; id != null_entity_id;
+			id = internal::get_entity_id(internal::read_handle(entities_src, id))) {
+			if ((u64)id >= header.entity_count || ++walked > free_count) { return false; }
+		}
+
+		if (walked != free_count) { return false; }
+
+		/* Which pool last had each entity, to catch duplicates. */
+		struct Seen {
+			u64* pools;
+			~Seen() { delete[] pools; }
+		} seen = { new u64[header.entity_count == 0 ? 1 : header.entity_count]() };
+
+		const u8* pools_src = src;
+
+		for (u64 i = 0; i < header.pool_count; i++) {
+			internal::Snapshot_Pool_Header ph;
+			if ((u64)(end - src) < sizeof(ph)) { return false; }
+
+			memcpy(&ph, src, sizeof(ph));
+			src += sizeof(ph);
+
+			u64 dense_size, data_size;
+			if (!internal::checked_mul(ph.count, sizeof(Entity_Handle), &dense_size) ||
+				!internal::checked_mul(ph.count, ph.element_size, &data_size) ||
+				dense_size + data_size < dense_size ||
+				(u64)(end - src) < dense_size + data_size) {
+				return false;
+			}
+
+			internal::Component_Pool* pool = nullptr;
+			for (u64 ii = 0; ii < pool_count; ii++) {
+				if (pools[ii].stable_id == ph.stable_id) {
+					pool = pools + ii;
+					break;
+				}
+			}
+
+			if (pool) {
+				if (pool->element_size != ph.element_size) { return false; }
+
+				/* Every component must belong to a live entity, once. */
+				for (u64 ii = 0; ii < ph.count; ii++) {
+					const Entity_Handle e = internal::read_handle(src, ii);
+					const Entity_ID id = internal::get_entity_id(e);
+
+					if ((u64)id >= header.entity_count || internal::read_handle(entities_src, id) != e ||
+						seen.pools[id] == i + 1) {
+						return false;
+					}
+
+					seen.pools[id] = i + 1;
+				}
+			}
+
+			src += dense_size + data_size;
+		}
+
+		/* Nothing can fail from here on. */
+		delete[] entities;
+		entity_capacity = header.entity_count < 8 ? 8 : header.entity_count;
+		entities = new Entity_Handle[entity_capacity];
+		memcpy(entities, entities_src, entities_size);
+
+		entity_count = header.entity_count;
+		alive_count = header.alive_count;
+		avail_id = header.avail_id;
+
+		src = pools_src;
+
+		for (u64 i = 0; i < header.pool_count; i++) {
+			internal::Snapshot_Pool_Header ph;
+			memcpy(&ph, src, sizeof(ph));
+			src += sizeof(ph);
+
+			const u64 dense_size = ph.count * sizeof(Entity_Handle);
+			const u64 data_size = ph.count * ph.element_size;
+
+			internal::Component_Pool* pool = nullptr;
+			for (u64 ii = 0; ii < pool_count; ii++) {
+				if (pools[ii].stable_id == ph.stable_id) {
+					pool = pools + ii;
+					break;
+				}
+			}
+
+			if (!pool) {
+				/* Not registered in this build; skip it. */
+				src += dense_size + data_size;
+				continue;
+			}
+
+			delete[] pool->dense;
+			delete[] pool->added_ticks;
+			delete[] pool->changed_ticks;
+			delete[] pool->data;
+			delete[] pool->sparse;
+
+			const u64 capacity = ph.count < 8 ? 8 : ph.count;
+
+			pool->dense = new Entity_Handle[capacity];
+			pool->added_ticks = new u64[capacity];
+			pool->changed_ticks = new u64[capacity];
+			pool->dense_capacity = capacity;
+			pool->dense_count = ph.count;
+
+			pool->data = new u8[capacity * pool->element_size];
+			pool->capacity = capacity;
+			pool->count = ph.count;
+			pool->removed_count = 0;
+
+			memcpy(pool->dense, src, dense_size);
+			src += dense_size;
+
+			memcpy(pool->data, src, data_size);
+			src += data_size;
+
+			pool->sparse_capacity = entity_count;
+			pool->sparse = new i64[entity_count == 0 ? 1 : entity_count];
+			for (u64 ii = 0; ii < entity_count; ii++) {
+				pool->sparse[ii] = -1;
+			}
+
+			for (u64 ii = 0; ii < ph.count; ii++) {
+				pool->sparse[internal::get_entity_id(pool->dense[ii])] = (i64)ii;
+				pool->added_ticks[ii] = tick;
+				pool->changed_ticks[ii] = tick;
+			}
+
+			if (pool->on_load) {
+				for (u64 ii = 0; ii < ph.count; ii++) {
+					pool->on_load(*this, pool->get_by_idx(ii));
+				}
+			}
+		}
+
+		return true;
+	}
+
 	Entity World::at(u64 i) {
 		return Entity(entities[i], this);
 	}
@@ -1094,5 +1678,29 @@ namespace ecs {
 	Entity View::get_entity() const {
 		return Entity(entity, world);
 	}
+
+	View& View::add_filter(Filter_Type type, u64 id, u64 since) {
+		assert(filter_count < max && "Too many filters on this view.");
+
+		if (entity == null_handle) {
+			return *this;
+		}
+
+		auto p = world->find_pool(id);
+		if (!p) {
+			/* Nothing has ever had this component, so nothing can pass. */
+			idx = 0;
+			entity = null_handle;
+			return *this;
+		}
+
+		filters[filter_count++] = Filter { type, p, since };
+
+		if (!contains(entity)) {
+			next();
+		}
+
+		return *this;
+	}
 #endif
 }
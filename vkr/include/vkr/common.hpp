@@ -39,6 +39,7 @@ namespace vkr {
 	/* Class forward declarations. */
 	class App;
 	class Buffer;
+	class CommandList;
 	class Framebuffer;
 	class IndexBuffer;
 	class Pipeline;
@@ -48,4 +49,5 @@ namespace vkr {
 	class UniformBuffer;
 	class VertexBuffer;
 	class VideoContext;
+	class WorkerPool;
 }
@@ -494,6 +494,39 @@ namespace vkr {
 		m4f transposed();
 	};
 
+	/* Planes of a view frustum, facing inwards, as (normal, distance). */
+	struct VKR_API Frustum {
+		v4f planes[6];
+
+		/* Expects a Vulkan style projection, with depth from zero to one. */
+		static Frustum from_matrix(const m4f& view_projection);
+
+		bool contains_sphere(v3f centre, f32 radius) const;
+		bool contains_aabb(const AABB& aabb) const;
+	};
+
+	/* Array versions of the m4f kernels, for hot loops that would otherwise
+	 * call the single-value versions once per element. `out' may be the
+	 * same array as the input. */
+	VKR_API void transform_points(const m4f& m, const v3f* in, v3f* out, usize count);
+	VKR_API void transform_aabbs(const m4f* ms, const AABB* aabbs, AABB* out, usize count);
+	VKR_API void mul_matrices(const m4f* a, const m4f* b, m4f* out, usize count);
+
+	/* Plain per-element versions of the m4f kernels. m4f uses SIMD versions
+	 * of these where the target supports it (see src/simd.hpp); these are
+	 * the fallback and the baseline for benchmarks. */
+	namespace scalar {
+		VKR_API m4f mul(const m4f& a, const m4f& b);
+		VKR_API m4f inverse(const m4f& m);
+		VKR_API m4f transposed(const m4f& m);
+		VKR_API v4f transform(const m4f& m, v4f v);
+		VKR_API AABB transform(const m4f& m, const AABB& aabb);
+
+		VKR_API void transform_points(const m4f& m, const v3f* in, v3f* out, usize count);
+		VKR_API void transform_aabbs(const m4f* ms, const AABB* aabbs, AABB* out, usize count);
+		VKR_API void mul_matrices(const m4f* a, const m4f* b, m4f* out, usize count);
+	}
+
 	inline static v4f make_color(u32 rgb, u8 a) {	
 		return v4f(
 			(f32)((rgb >> 16) & 0xff) / 255.0f,
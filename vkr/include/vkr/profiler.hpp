@@ -0,0 +1,48 @@
+#pragma once
+
+#include "common.hpp"
+
+/* Scoped CPU timers for finding frame spikes without external tools.
+ *
+ * Each thread records into a ring buffer of its own, so recording takes
+ * no locks, and the most recent events of every thread can be written
+ * out as Chrome's trace event JSON, to be opened in chrome://tracing or
+ * Perfetto. The macros only record anything with VKR_PROFILE defined
+ * (premake's --profile option); otherwise they expand to nothing. */
+
+namespace vkr {
+	namespace profiler {
+		/* Events kept per thread; the oldest are overwritten first. */
+		static constexpr usize ring_size = 1 << 14;
+
+		/* Nanoseconds from the steady clock. */
+		VKR_API u64 now();
+
+		/* name must outlive the profiler, so a string literal or __func__. */
+		VKR_API void record(const char* name, u64 begin, u64 end);
+
+		/* Writes out what every thread's buffer holds. Events recorded while
+		 * it runs may or may not make it in. */
+		VKR_API bool write_trace(const char* path);
+
+		class Scope {
+		private:
+			const char* name;
+			u64 begin;
+		public:
+			inline Scope(const char* name) : name(name), begin(now()) {}
+			inline ~Scope() { record(name, begin, now()); }
+		};
+	}
+}
+
+#ifdef VKR_PROFILE
+	#define profile_concat_(a_, b_) a_##b_
+	#define profile_concat(a_, b_) profile_concat_(a_, b_)
+
+	#define profile_scope(name_) vkr::profiler::Scope profile_concat(profile_scope_, __LINE__)(name_)
+	#define profile_function() profile_scope(__func__)
+#else
+	#define profile_scope(name_)
+	#define profile_function()
+#endif
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <string>
 #include <vector>
 #include <unordered_map>
 
@@ -8,13 +9,40 @@
 #include "common.hpp"
 #include "maths.hpp"
 #include "wavefront.hpp"
+#include "workers.hpp"
 
 namespace vkr {
 	class Mesh3D;
 	class Model3D;
 	class Renderer3D;
-
-	static usize constexpr max_point_lights = 256;
+	struct PointLight;
+	struct Camera;
+
+	static usize constexpr max_point_lights = 4096;
+
+	/* Point lights are assigned to a grid of clusters over the view
+	 * frustum, tiled in screen space and sliced exponentially in depth,
+	 * so that each pixel only shades the lights that can reach it. These
+	 * must match the definitions in lighting.glsl. */
+	static usize constexpr cluster_grid_x = 16;
+	static usize constexpr cluster_grid_y = 9;
+	static usize constexpr cluster_grid_z = 24;
+	static usize constexpr cluster_count = cluster_grid_x * cluster_grid_y * cluster_grid_z;
+	static usize constexpr max_cluster_light_indices = 1 << 17;
+
+	/* The sun's shadow is split into cascades by view depth, each with its
+	 * own shadow map. Must match the definition in lit.glsl. */
+	static usize constexpr shadow_cascade_count = 4;
+	static i32   constexpr shadow_cascade_res = 1024;
+
+	/* Cascades after the first only follow the camera once it has moved
+	 * this fraction of the cascade's radius, so that they can be kept
+	 * between frames instead of being re-rendered. */
+	static f32   constexpr shadow_cascade_update_threshold = 0.1f;
+
+	/* Number of times the bloom is halved after the bright pass, which is
+	 * itself half the size of the screen. */
+	static usize constexpr bloom_levels = 4;
 
 	class VKR_API PostProcessStep {
 	private:
@@ -24,6 +52,7 @@ namespace vkr {
 		Renderer3D* renderer;
 
 		bool use_default_fb;
+		bool owns_fb;
 		usize dependency_count;
 
 		void* pc;
@@ -33,10 +62,28 @@ namespace vkr {
 			const char* name;
 			Framebuffer* framebuffer;
 			u32 attachment;
+
+			/* Unfiltered if null. */
+			Sampler* sampler = null;
+		};
+
+		/* Bound to the first descriptor set in order, starting at binding
+		 * 2, after the post-processing config and the uniform buffer. */
+		struct StorageBuffer {
+			const char* name;
+			void* ptr;
+			usize size;
+			const usize* used_size = null; /* See Pipeline::ResourcePointer. */
 		};
 
+		/* scale sets the size of the output relative to the screen, and
+		 * is ignored when drawing to the default framebuffer. If target
+		 * is set, the step draws into it instead of creating a framebuffer
+		 * of its own, and doesn't take ownership of it. */
 		PostProcessStep(Renderer3D* renderer, Shader* shader, Dependency* dependencies, usize dependency_count, bool use_default_fb = false,
-			void* uniform_buffer = null, usize uniform_buffer_size = 0, void* pc = null, usize pc_size = 0);
+			void* uniform_buffer = null, usize uniform_buffer_size = 0, void* pc = null, usize pc_size = 0,
+			StorageBuffer* storage_buffers = null, usize storage_buffer_count = 0, f32 scale = 1.0f,
+			Framebuffer* target = null);
 		~PostProcessStep();
 
 		void execute();
@@ -44,6 +91,140 @@ namespace vkr {
 		inline Framebuffer* get_framebuffer() { return framebuffer; }
 	};
 
+	/* Builds a chain of post-processing steps from passes that name the
+	 * images they read and write, instead of wiring framebuffers together
+	 * by hand. compile works out the order to run the passes in and gives
+	 * each image a framebuffer, sharing one framebuffer between images
+	 * whose lifetimes within the frame don't overlap.
+	 *
+	 * The framebuffers still transition their own layouts as each pass
+	 * begins and ends, so the order is all that is needed for those
+	 * barriers to be correct. */
+	class VKR_API RenderGraph {
+	public:
+		struct Input {
+			const char* name;
+			Sampler* sampler = null; /* Unfiltered if null. */
+		};
+
+		struct Pass {
+			const char* name;
+			Shader* shader;
+
+			/* Bound to the second descriptor set, in order. */
+			const Input* inputs;
+			usize input_count;
+
+			/* The image written, or null to draw to the default framebuffer.
+			 * Those passes run last, from execute_to_default_framebuffer. */
+			const char* output;
+			f32 scale = 1.0f;
+
+			/* Samples every input only at the uv being written, so the pass
+			 * can be fused with the one before or after it. */
+			bool per_pixel = false;
+
+			void* uniform_buffer = null;
+			usize uniform_buffer_size = 0;
+			void* pc = null;
+			usize pc_size = 0;
+			PostProcessStep::StorageBuffer* storage_buffers = null;
+			usize storage_buffer_count = 0;
+		};
+
+		struct MemoryReport {
+			usize image_count;       /* Images written by passes. */
+			usize framebuffer_count; /* Framebuffers backing them. */
+			usize bytes;             /* Approximate, including every frame in flight. */
+			usize unaliased_bytes;   /* The same, if every image had a framebuffer of its own. */
+			usize fused_passes;      /* Passes folded into the pass that reads them. */
+		};
+	private:
+		struct Image {
+			std::string name;
+
+			Framebuffer* framebuffer;
+			u32 attachment;
+
+			bool external;
+			f32 scale;
+
+			/* Positions in the execution order. */
+			usize first;
+			usize last;
+		};
+
+		struct Node {
+			std::string name;
+			Shader* shader;
+
+			std::vector<std::string> inputs;
+			std::vector<Sampler*> samplers;
+			std::string output; /* Empty for the default framebuffer. */
+			f32 scale;
+			bool per_pixel;
+
+			void* uniform_buffer;
+			usize uniform_buffer_size;
+			void* pc;
+			usize pc_size;
+			std::vector<PostProcessStep::StorageBuffer> storage_buffers;
+
+			PostProcessStep* step;
+		};
+
+		struct Fusion {
+			std::string first;
+			std::string second;
+			Shader* shader;
+		};
+
+		Renderer3D* renderer;
+
+		std::vector<Image> images;
+		std::vector<Node> nodes;
+		std::vector<usize> order;
+
+		std::vector<Fusion> fusions;
+		usize fused_passes;
+
+		/* Passes from here in the order draw to the default framebuffer. */
+		usize default_fb_start;
+
+		/* Framebuffers owned by the graph, shared between images. */
+		std::vector<Framebuffer*> framebuffers;
+
+		bool compiled;
+
+		Image* find_image(const std::string& name);
+		void fuse();
+	public:
+		RenderGraph(Renderer3D* renderer);
+		~RenderGraph();
+
+		/* An image produced outside of the graph, such as the G-buffer. */
+		void add_external(const char* name, Framebuffer* framebuffer, u32 attachment);
+		void add_pass(const Pass& pass);
+
+		/* Provides a shader that does the work of pass `first' and then pass
+		 * `second' in one draw. Its inputs are second's, with the image that
+		 * first writes replaced by first's own inputs. The passes are only
+		 * fused if both are per-pixel, are the same size and nothing else
+		 * reads the image between them. The fused pass is named
+		 * "first+second", so it can be fused again. */
+		void add_fusion(const char* first, const char* second, Shader* shader);
+
+		void compile();
+
+		void execute();
+		void execute_to_default_framebuffer();
+
+		Framebuffer* get_framebuffer(const char* name);
+
+		MemoryReport get_memory_report() const;
+		void print_memory_report() const;
+	};
+
 	class VKR_API Renderer3D {
 	public:
 		struct Material {
@@ -63,10 +244,21 @@ namespace vkr {
 			Shader* lighting;
 			Shader* tonemap;
 			Shader* bright_extract;
-			Shader* blur_v;
-			Shader* blur_h;
+			Shader* bloom_downsample;
+			Shader* bloom_upsample;
 			Shader* composite;
 			Shader* shadowmap;
+
+			/* Optional; tonemap and composite are fused into it if set. */
+			Shader* tonemap_composite = null;
+		};
+
+		/* What the scene pass writes for the lighting pass to read. The lit
+		 * and lighting shaders must be built for the same layout; see
+		 * COMPACT_GBUFFER in lit.glsl and lighting.glsl. */
+		enum class GBufferLayout {
+			full,   /* rgbaf16 colour, normals and world positions. */
+			compact /* r11g11b10f colour and rgf16 octahedral normals. Positions come from depth. */
 		};
 	private:
 		struct impl_PointLight {
@@ -94,13 +286,9 @@ namespace vkr {
 			alignas(4)  f32 emissive;
 		};
 
-		struct {
-			m4f view, projection, sun_matrix;
-		} v_ub;
-
 		struct {
 			m4f view, projection;
-		} shadow_v_ub;
+		} v_ub;
 
 		struct {
 			alignas(16) v3f camera_pos;
@@ -112,15 +300,51 @@ namespace vkr {
 
 			alignas(4) i32 blocker_search_sample_count;
 			alignas(4) i32 pcf_sample_count;
+			alignas(4) i32 shadow_quality;
 
 			impl_DirectionalLight sun;
+
+			alignas(16) v4f cascade_splits; /* Far view depth of each cascade. */
+			alignas(16) v4f cascade_scales; /* Size of the first cascade relative to each. */
+			alignas(16) m4f sun_matrices[shadow_cascade_count];
 		} f_ub;
 
+		struct impl_Cluster {
+			u32 offset;
+			u32 count;
+		};
+
 		struct {
+			m4f view;
+			m4f inv_view_projection; /* For finding positions from depth with the compact G-buffer. */
 			alignas(4) i32 point_light_count;
-			alignas(16) impl_PointLight point_lights[max_point_lights];
+			alignas(4) f32 cluster_z_scale;
+			alignas(4) f32 cluster_z_bias;
 		} light_ub;
 
+		/* Storage buffers for the lighting pass. */
+		impl_PointLight* point_lights;
+		impl_Cluster* clusters;
+		u32* cluster_light_indices;
+
+		/* How much of point_lights and cluster_light_indices is in use,
+		 * in bytes, so that the rest isn't uploaded. */
+		usize point_lights_used_size;
+		usize cluster_light_indices_used_size;
+
+		struct VisibleLight {
+			const PointLight* light;
+			v3f position;
+			f32 importance;
+		};
+
+		std::vector<VisibleLight> visible_lights;
+
+		/* Per-light cluster bounds, as min x, y, z and max x, y, z. */
+		std::vector<u32> light_cluster_bounds;
+
+		void assign_light_clusters(const m4f& projection, f32 near, f32 far);
+
 		struct {
 			alignas(4)  f32 bloom_threshold;
 			alignas(4)  f32 bloom_blur_intensity;
@@ -141,34 +365,92 @@ namespace vkr {
 
 		VertexBuffer* fullscreen_tri;
 
+		struct ShadowCascade {
+			Framebuffer* fb;
+			Pipeline* pip;
+
+			struct {
+				m4f view, projection;
+			} v_ub;
+
+			/* What the cascade was last built from. A change to either
+			 * bumps the version, which each frame in flight then has to
+			 * catch up to by re-rendering its copy of the shadow map. */
+			m4f matrix;
+			usize caster_count;
+			u64 caster_keys;
+
+			u64 version;
+			std::vector<u64> rendered_versions;
+
+			/* This frame's casters, as indices into the draw lists, and
+			 * whether this frame in flight's shadow map needs them drawn. */
+			std::vector<u32> casters;
+			bool stale;
+
+			/* For recording the cascade on another thread. */
+			CommandList* list;
+		};
+
+		ShadowCascade cascades[shadow_cascade_count];
+
+		void draw_shadows(const Camera& camera, v3f cam_dir, f32 aspect, const AABB& scene_aabb);
+
+		/* Draw commands for the shadow and scene passes, into whichever
+		 * command buffer or list is being recorded on the calling thread. */
+		void record_shadow_casters(const ShadowCascade& cascade);
+		void record_scene(usize first, usize last);
+
+		/* One per run of the scene's draws, for the scene pass. */
+		std::vector<CommandList*> scene_lists;
+
+		/* Records the passes in parallel; started once, with the renderer. */
+		WorkerPool* workers;
+
 		Pipeline* scene_pip;
-		Pipeline* shadow_pip;
 		App* app;
 
-		PostProcessStep* lighting; /* Deferred lighting. */
-		PostProcessStep* bright_extract;
-		PostProcessStep* blur_v;
-		PostProcessStep* blur_h;
-		PostProcessStep* blur_v2;
-		PostProcessStep* blur_h2;
-		PostProcessStep* tonemap;
-		PostProcessStep* composite;
+		/* Deferred lighting, tonemapping, bloom and the final composite. */
+		RenderGraph* post;
 
 		Texture* default_texture;
 
+		GBufferLayout gbuffer_layout;
 		Framebuffer* scene_fb;
-		Framebuffer* shadow_fb;
 
 		Sampler* shadow_sampler;
 		Sampler* fb_sampler;
+		Sampler* bloom_sampler;
 
 		Model3D* model;
 
 		Material* materials;
 
+		/* What draw reads from the world, copied out of it. There are two,
+		 * so that the next frame's can be taken while this frame's is being
+		 * drawn; front_snapshot is the one draw uses. */
+		struct Snapshot;
+		Snapshot* snapshots;
+		usize front_snapshot;
+
+		/* Per-frame scratch, kept to avoid reallocating. */
+		std::vector<AABB> light_aabbs; /* The snapshot's bounds in the sun's view space. */
+
 		friend class PostProcessStep;
+		friend class RenderGraph;
 	public:
+		/* How the sun's shadows are filtered, cheapest first. Must match
+		 * the definitions in lit.glsl. */
+		enum class ShadowQuality : i32 {
+			hard = 0,  /* A single hardware filtered tap. */
+			pcf,       /* A fixed 3x3 kernel of hardware filtered taps. */
+			pcss_low,  /* PCSS, with at most 16 taps for the blocker search and the filter each. */
+			pcss_high  /* PCSS, with the sample counts below. */
+		};
+
 		struct {
+			ShadowQuality quality;
+
 			v3f direction;
 			f32 intensity;
 			f32 bias;
@@ -176,23 +458,70 @@ namespace vkr {
 			v3f specular;
 			v3f diffuse;
 
+			/* Only used by the PCSS tiers, and clamped to the size of
+			 * the Poisson disk. */
 			int blocker_search_sample_count;
 			int pcf_sample_count;
+
+			/* How far from the camera the cascades reach, and how they are
+			 * spread over that distance: zero splits evenly, one splits
+			 * logarithmically. */
+			f32 shadow_distance;
+			f32 cascade_split_lambda;
 		} sun;
 
+		/* Counters from the last call to draw. */
+		struct {
+			usize point_lights_total;
+			usize point_lights_visible;
+			usize point_lights_dropped; /* Visible, but over max_point_lights. */
+			usize shadow_cascades_rendered;
+			usize shadow_casters_drawn;   /* Summed over the cascades rendered. */
+			usize shadow_casters_skipped; /* Culled from the cascades rendered. */
+			usize scene_draws;            /* Meshes drawn in the scene pass. */
+		} stats;
+
+		/* Scenes with at least parallel_record_threshold renderables have
+		 * their shadow cascades and their scene pass recorded in parallel,
+		 * with the scene's draws split into this many runs. Defaults to the
+		 * number of threads in the worker pool. */
+		usize record_thread_count;
+		static constexpr usize parallel_record_threshold = 256;
+
 		/* Post processing config. */
 		struct {
 			f32 bloom_threshold;
-			f32 bloom_blur_intensity;
+			f32 bloom_blur_intensity; /* Spread of the bloom filter's taps, in texels. */
 			f32 bloom_intensity;
 		} pp_config;
 
-		Renderer3D(App* app, VideoContext* video, const ShaderConfig& shaders, Material* materials, usize material_count);
+		Renderer3D(App* app, VideoContext* video, const ShaderConfig& shaders, Material* materials, usize material_count,
+			GBufferLayout gbuffer_layout = GBufferLayout::full);
 		~Renderer3D();
 
+		/* Copies the renderables, point lights and camera out of the world
+		 * into the back snapshot. It doesn't touch anything draw reads, so
+		 * it may run while another thread draws the front one. */
+		void snapshot(ecs::World* world, ecs::Entity camera_ent);
+
+		/* Makes the last snapshot the front one. Not while drawing. */
+		void swap_snapshots();
+
+		/* Draws the front snapshot. sun, pp_config and the materials are
+		 * read here rather than snapshotted, so with App::threaded_frames
+		 * they should only be changed from on_snapshot. */
+		void draw();
+
+		/* snapshot, swap_snapshots and draw, for the serial loop. */
 		void draw(ecs::World* world, ecs::Entity camera_ent);
 		void draw_to_default_framebuffer();
 
+		inline RenderGraph* get_post_graph() const { return post; }
+
+		/* Shared with anything else that wants to spread work over the
+		 * renderer's threads, such as a TransformHierarchy. */
+		inline WorkerPool* get_workers() const { return workers; }
+
 		struct Vertex {
 			v3f position;
 			v2f uv;
@@ -309,8 +638,8 @@ namespace vkr {
 		Pipeline* pipeline;
 		VertexBuffer* vb;
 
-		static constexpr usize max_quads = 500;
 		static constexpr usize verts_per_quad = 6;
+		usize max_quads;
 		usize quad_count;
 		usize quad_offset;
 
@@ -326,7 +655,10 @@ namespace vkr {
 
 		bool want_recreate;
 	public:
-		VKR_API Renderer2D(VideoContext* video, Shader* shader, Bitmap** images, usize image_count, Framebuffer* framebuffer);
+		/* max_quads is how many quads can be pushed between a begin and
+		 * an end; any more are dropped. Each glyph of text is a quad. */
+		VKR_API Renderer2D(VideoContext* video, Shader* shader, Bitmap** images, usize image_count, Framebuffer* framebuffer,
+			usize max_quads = 500);
 		VKR_API ~Renderer2D();
 
 		VKR_API void begin(v2i screen_size);
@@ -349,5 +681,12 @@ namespace vkr {
 		VKR_API void push(Font* font, const char* text, v2f position, v4f color = v4f(1.0f, 1.0f, 1.0f, 1.0f));
 
 		VKR_API void set_clip(Rect clip);
+
+		/* Counters since the last call to begin. */
+		struct {
+			usize quads;
+			usize quads_dropped; /* Over max_quads. */
+			usize draws;
+		} stats;
 	};
 }
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include <ecs/ecs.hpp>
+
+#include "common.hpp"
+#include "maths.hpp"
+
+namespace vkr {
+	class Model3D;
+
+	/* Saves and loads the renderer's components to and from binary
+	 * snapshots (see ecs::World::write_snapshot).
+	 *
+	 * Models can't be stored by pointer, so they are written as the
+	 * hash of the path they were registered with using add_model. Any
+	 * model that a saved Renderable3D references must be registered
+	 * before loading. */
+	class VKR_API SceneSerialiser {
+	private:
+		ecs::World* world;
+
+		std::unordered_map<u64, Model3D*> models;
+		std::unordered_map<Model3D*, u64> model_hashes;
+	public:
+		SceneSerialiser(ecs::World* world);
+
+		void add_model(const char* path, Model3D* model);
+
+		bool save(const char* path);
+
+		/* The world must not have any living entities. */
+		bool load(const char* path);
+	};
+
+	/* Local translation, rotation and scale, relative to the parent if
+	 * the entity has one. Rotation is in degrees, applied in Y, X, Z
+	 * order, like the camera. */
+	struct LocalTransform {
+		v3f translation;
+		v3f rotation;
+		v3f scale = v3f(1.0f);
+
+		VKR_API m4f get_matrix() const;
+	};
+
+	/* Attaches an entity to another. Both must have a LocalTransform.
+	 * Change the parent with Entity::set, or by adding or removing the
+	 * component, so that the hierarchy notices. */
+	struct Parent {
+		ecs::Entity entity;
+	};
+
+	/* Computes the world space Transform of every entity that has a
+	 * LocalTransform.
+	 *
+	 * Entities are kept in depth-first order, so that each parent is
+	 * resolved before its children. The order is only rebuilt when
+	 * the structure changes. Pointers to each node's components are
+	 * cached along with it, and only taken again when the pools move.
+	 * Only subtrees with a LocalTransform that changed since the last
+	 * update get their matrices recomputed. Given a worker pool,
+	 * independent roots are processed in parallel when the hierarchy is
+	 * large enough to make it worthwhile.
+	 *
+	 * Local transforms must be written through Entity::set (or marked
+	 * as changed) for this to pick them up. */
+	class VKR_API TransformHierarchy {
+	private:
+		struct Node {
+			ecs::Entity_Handle handle;
+			i64 parent; /* Index into nodes, or -1 for a root. */
+		};
+
+		ecs::World* world;
+
+		std::vector<Node> nodes;
+		std::unordered_map<ecs::Entity_Handle, usize> node_indices;
+
+		/* Index of the first node in each root's subtree, followed by
+		 * nodes.size(), so that root i spans [roots[i], roots[i + 1]). */
+		std::vector<usize> roots;
+
+		std::vector<const LocalTransform*> locals;
+		std::vector<m4f*> worlds;
+		std::vector<u8> dirty;
+
+		u64 last_tick;
+		WorkerPool* workers;
+
+		bool want_rebuild;
+
+		bool structure_changed();
+		bool pools_moved();
+		void rebuild();
+		bool cache_components();
+		void propagate(usize first_root, usize last_root);
+		void propagate_dirty();
+	public:
+		/* workers may be shared, for example Renderer3D::get_workers();
+		 * without any, everything runs on the calling thread. */
+		TransformHierarchy(ecs::World* world, WorkerPool* workers = null);
+		~TransformHierarchy();
+
+		/* The world holds on to a pointer to last_tick. */
+		TransformHierarchy(const TransformHierarchy&) = delete;
+		TransformHierarchy& operator=(const TransformHierarchy&) = delete;
+
+		void update();
+
+		/* Runs the next update over every node. */
+		void invalidate();
+
+		static constexpr usize parallel_threshold = 4096;
+	};
+}
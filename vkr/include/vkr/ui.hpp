@@ -156,6 +156,12 @@ namespace vkr {
 
 		VKR_API void columns(usize count, ...);
 
+		/* A row per GPU timer from VideoContext::get_gpu_timings, with
+		 * nested timers indented, and the total of the outermost ones.
+		 * For use inside a window; the video context's gpu_timers must
+		 * be on for there to be anything to show. */
+		VKR_API void gpu_timings(const VideoContext* video);
+
 		/* Advances the cursor position to the correct
 		 * place to draw the next element. `last_height'
 		 * describes the height of the last element
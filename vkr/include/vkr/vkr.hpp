@@ -1,11 +1,15 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+
 #include <stdint.h>
 #include <stdarg.h>
 
 #include "common.hpp"
 #include "maths.hpp"
 #include "renderer.hpp"
+#include "scene.hpp"
 #include "ui.hpp"
 #include "wavefront.hpp"
 
@@ -33,6 +37,7 @@ namespace vkr {
 	 * namely glfw3.h and vulkan.h. */
 	struct impl_App;
 	struct impl_Buffer;
+	struct impl_CommandList;
 	struct impl_Framebuffer;
 	struct impl_Pipeline;
 	struct impl_Sampler;
@@ -130,6 +135,39 @@ namespace vkr {
 		mouse_button_count
 	};
 
+	/* Counts frame times into buckets, to show how even the pacing is
+	 * rather than just its average. Times past the last bucket are
+	 * counted in an overflow bucket. */
+	class VKR_API FrameTimeHistogram {
+	public:
+		static constexpr usize bucket_count = 400;
+		static constexpr f64 bucket_width = 0.00025; /* In seconds; 400 of them cover 100ms. */
+
+		FrameTimeHistogram();
+
+		void add(f64 seconds);
+		void reset();
+
+		inline usize get_count() const { return count; }
+		inline f64 get_min() const { return count > 0 ? min : 0.0; }
+		inline f64 get_max() const { return max; }
+		inline f64 get_mean() const { return count > 0 ? total / (f64)count : 0.0; }
+
+		inline usize get_bucket(usize i) const { return buckets[i]; }
+		inline usize get_overflow() const { return buckets[bucket_count]; }
+
+		/* The time that at least p (from 0 to 1) of the frames took no
+		 * longer than, to the upper edge of its bucket. */
+		f64 percentile(f64 p) const;
+
+		/* Logs the percentiles and a bar for each millisecond. */
+		void print() const;
+	private:
+		usize buckets[bucket_count + 1];
+		usize count;
+		f64 total, min, max;
+	};
+
 	/* To be inherited by client applications to provide custom
 	 * functionality and data. */
 	class App {
@@ -143,15 +181,56 @@ namespace vkr {
 
 		bool create_window_surface(const VideoContext& ctx) const;
 
+		bool quit_requested;
+
 		friend class VideoContext;
 	public:
 		v2i size, mouse_pos;
 		VideoContext* video;
 
+		/* Set before run to draw each frame on a thread of its own, while
+		 * the main thread updates the next one. on_update then mustn't use
+		 * the video context at all; on_render draws from whatever
+		 * on_snapshot copied out for it, and on_snapshot is the only
+		 * point where both are stopped, so it is also where to create
+		 * resources and change anything on_render reads. Without it the
+		 * three are called in turn, between VideoContext::begin and end. */
+		bool threaded_frames;
+
+		/* If above zero, on_update is passed this instead of the frame's
+		 * time and called as many times as the time elapsed allows, with
+		 * the remainder carried over to the next frame. It may run zero or
+		 * several times in a frame, so it mustn't draw; on_render can use
+		 * interpolation_alpha, the remainder as a fraction of a step, to
+		 * blend between the last two steps. It is set just before
+		 * on_snapshot and left alone until the next one, so it always
+		 * belongs to the frame being rendered. To keep a slow frame from
+		 * snowballing, no more than max_fixed_updates run in a frame and
+		 * the time left over beyond that is dropped. */
+		f64 fixed_timestep;
+		u32 max_fixed_updates;
+		f64 interpolation_alpha;
+
+		/* If above zero, each frame is padded out on the CPU to last at
+		 * least 1 / max_frame_rate seconds. The other way of pacing is
+		 * VideoContext::set_present_mode. */
+		f64 max_frame_rate;
+
+		/* The time of every frame since run started. */
+		FrameTimeHistogram frame_times;
+
+		/* Set before run to render without a window, to the default
+		 * framebuffer as an off-screen framebuffer that can be read back.
+		 * There's no input either, so the app has to call quit itself.
+		 * Works on CPU implementations of Vulkan such as lavapipe. */
+		bool headless;
+
 		VKR_API App(const char* title, v2i size);
 
 		virtual void on_init() = 0;
 		virtual void on_update(f64) = 0;
+		virtual void on_snapshot() {}
+		virtual void on_render() {}
 		virtual void on_deinit() = 0;
 
 		VKR_API virtual ~App() {};
@@ -164,6 +243,9 @@ namespace vkr {
 		VKR_API void lock_mouse();
 		VKR_API void unlock_mouse();
 
+		/* Ends run after the current frame. */
+		VKR_API void quit();
+
 		bool held_keys    [static_cast<i32>(key_count)];
 		bool pressed_keys [static_cast<i32>(key_count)];
 		bool released_keys[static_cast<i32>(key_count)];
@@ -197,8 +279,11 @@ namespace vkr {
 
 		bool is_recreating;
 
+		const char* gpu_timer_name;
+
 		friend class VideoContext;
 		friend class Pipeline;
+		friend class CommandList;
 	public:
 		enum class Flags {
 			default_fb    = 1 << 0, /* To be managed by the video context only. */
@@ -222,7 +307,9 @@ namespace vkr {
 				rgbaf32,
 				redf16,
 				rgbf16,
-				rgbaf16
+				rgbaf16,
+				rgf16,
+				r11g11b10f  /* Unsigned, with no alpha. Falls back to rgbaf16 where unsupported. */
 			} format;
 		};
 
@@ -232,13 +319,30 @@ namespace vkr {
 		~Framebuffer();
 
 		inline v2i get_size() const { return size; }
-		inline v2i get_scaled_size() const { return v2i((i32)((f32)size.x * scale), (i32)((f32)size.y * scale)); }
+		inline v2i get_scaled_size() const {
+			/* Heavily scaled down framebuffers must still be at least a pixel. */
+			return v2i(
+				std::max((i32)((f32)size.x * scale), 1),
+				std::max((i32)((f32)size.y * scale), 1));
+		}
 		inline v2i get_drawable_size() const { return drawable_size; }
 
 		void resize(v2i size);
 
-		void begin();
+		/* With command_lists set, the pass may only contain
+		 * CommandList::execute calls, and nothing recorded directly. */
+		void begin(bool command_lists = false);
 		void end();
+
+		/* If set, each begin/end pair is timed on the GPU under this
+		 * name. See VideoContext::begin_gpu_timer. */
+		inline void set_gpu_timer_name(const char* name) { gpu_timer_name = name; }
+
+		/* Copies what the last frame drew into an rgba8 colour attachment
+		 * of a headless framebuffer into dst, which must hold
+		 * get_scaled_size().x * get_scaled_size().y * 4 bytes. Waits for
+		 * the GPU to finish everything first, so it's slow. */
+		bool read_back(u32 attachment, void* dst);
 	private:
 		Attachment* attachments;
 		usize attachment_count;
@@ -283,7 +387,8 @@ namespace vkr {
 			enum class Type {
 				texture,
 				framebuffer_output,
-				uniform_buffer
+				uniform_buffer,
+				storage_buffer
 			} type;
 
 			union {
@@ -292,6 +397,17 @@ namespace vkr {
 					usize size;
 				} uniform;
 
+				/* Like uniform buffers, storage buffers are copied from
+				 * `ptr' when the pipeline begins. They're read-only and
+				 * can be much larger than uniform buffers. If used_size
+				 * is set, only that many bytes from the start are copied,
+				 * and the shader mustn't read past them. */
+				struct {
+					void* ptr;
+					usize size;
+					const usize* used_size;
+				} storage;
+
 				struct {
 					Texture* ptr;
 				} texture;
@@ -336,7 +452,7 @@ namespace vkr {
 			front_face_clockwise         = 1 << 4,
 			front_face_counter_clockwise = 1 << 5,
 			blend                        = 1 << 6,
-			dynamic_scissor              = 1 << 7,
+			dynamic_scissor              = 1 << 7, /* Viewport and scissor are always dynamic; kept for existing users. */
 		} flags;
 
 		Pipeline(VideoContext* video, Flags flags, Shader* shader, usize stride,
@@ -348,9 +464,16 @@ namespace vkr {
 
 		void clear();
 
-		void begin();
+		/* With upload unset, the uniform buffers aren't uploaded, and the
+		 * descriptor sets bind whatever upload_uniforms last uploaded this
+		 * frame. Several command lists can record the same pipeline at once
+		 * this way, as long as upload_uniforms was called beforehand on
+		 * one thread. */
+		void begin(bool upload = true);
 		void end();
 
+		void upload_uniforms();
+
 		void set_scissor(v4i rect);
 
 		void push_constant(Stage stage, const void* ptr, usize size, usize offset = 0);
@@ -361,11 +484,13 @@ namespace vkr {
 			push_constant(stage, &c, sizeof(T), offset);
 		}
 
+		/* Re-writes descriptors that sample framebuffers, after they are
+		 * re-created on resize. */
 		void recreate();
 
 	private:
-		/* Cache for all of the constructor arguments for re-creating
-		 * the pipeline whenever the window is resized. */
+		/* Copies of the constructor arguments. The descriptor sets are
+		 * used to re-point framebuffer descriptors on resize. */
 		Shader* shader;
 		usize stride;
 		Attribute* attribs;
@@ -375,7 +500,10 @@ namespace vkr {
 		PushConstantRange* pcranges;
 		usize pcrange_count;
 
-		usize uniform_count, sampler_count;
+		/* uniform_count includes storage buffers, as they are both backed
+		 * by a CPU-side copy; storage_count is only used to size the
+		 * descriptor pool. */
+		usize uniform_count, storage_count, sampler_count;
 	};
 
 	inline Pipeline::Flags operator|(Pipeline::Flags a, Pipeline::Flags b) {
@@ -417,6 +545,29 @@ namespace vkr {
 		void draw();
 	};
 
+	/* A secondary command buffer, so that the contents of a render pass can
+	 * be recorded from several threads at once. Each list has a command pool
+	 * of its own and must only be recorded by one thread at a time.
+	 *
+	 * Between begin() and end(), calls on Pipeline, VertexBuffer and
+	 * IndexBuffer from the recording thread go into the list instead of the
+	 * frame's command buffer; Pipeline::begin() must be called again in the
+	 * list. The lists are then executed, in order, from the main thread
+	 * between begin(true) and end() on the framebuffer they were begun for. */
+	class VKR_API CommandList {
+	private:
+		VideoContext* video;
+		impl_CommandList* handle;
+	public:
+		CommandList(VideoContext* video);
+		~CommandList();
+
+		void begin(Framebuffer* framebuffer);
+		void end();
+
+		void execute();
+	};
+
 	class VKR_API Sampler {
 	private:
 		impl_Sampler* handle;
@@ -471,6 +622,8 @@ namespace vkr {
 			format_rgba32 = 1 << 13
 		} flags;
 
+		/* Textures with filter_linear get a full mip chain, blitted down
+		 * from data on the GPU, and are sampled trilinearly. */
 		Texture(VideoContext* video, const void* data, v2i size, Flags flags);
 		~Texture();
 
@@ -494,14 +647,13 @@ namespace vkr {
 		u32 current_frame;
 		u32 image_id;
 
-		usize object_count;
+		std::atomic<usize> object_count;
 
 		Framebuffer* default_fb;
 
-		Pipeline* pipeline;
-
 		friend class App;
 		friend class Buffer;
+		friend class CommandList;
 		friend class IndexBuffer;
 		friend class Pipeline;
 		friend class VertexBuffer;
@@ -510,6 +662,11 @@ namespace vkr {
 		void init_swapchain();
 		void deinit_swapchain();
 
+		/* Copies data into this frame's uniform ring and returns the
+		 * offset to bind it at. At least reserve bytes are set aside
+		 * from there, for bindings larger than what is copied. */
+		u32 upload_uniform(const void* ptr, usize size, usize reserve = 0);
+
 		const App& app;
 
 		/* Stored to iterate over and re-create when the
@@ -520,10 +677,42 @@ namespace vkr {
 		bool skip_frame;
 
 		bool validation_layers_enabled;
+
+		bool headless;
+	public:
+		/* How frames are queued for the display. fifo waits for vertical
+		 * blank and so caps the frame rate at the refresh rate; mailbox
+		 * doesn't tear either, but replaces the queued frame so that
+		 * rendering never waits, for lower latency; immediate presents
+		 * straight away and may tear. Unsupported modes fall back to fifo. */
+		enum class PresentMode {
+			fifo,
+			mailbox,
+			immediate
+		};
+
+		struct GPUTiming {
+			const char* name;
+			u32 depth; /* How many timers it was nested in. */
+			f64 ms;
+		};
+
+		/* In bytes, over every heap. */
+		struct MemoryUsage {
+			usize allocated; /* By live buffers and images. */
+			usize reserved;  /* By the blocks they are sub-allocated from. */
+		};
+	private:
+		PresentMode present_mode;
+
+		std::vector<GPUTiming> gpu_timings;
 	public:
 		impl_VideoContext* handle;
 		bool want_recreate;
 
+		/* Whether begin_gpu_timer does anything; off by default. */
+		bool gpu_timers;
+
 		VKR_API VideoContext(const App& app, const char* app_name, bool enable_validation_layers, u32 extension_count, const char** extensions);
 		VKR_API ~VideoContext();
 
@@ -535,7 +724,36 @@ namespace vkr {
 
 		VKR_API void resize(v2i new_size);
 
+		/* Time the commands between them on the GPU. They nest, and must
+		 * be called in between begin and end, outside of any command list.
+		 * name is kept until the results come back, so it must outlive
+		 * the frames in flight. */
+		VKR_API void begin_gpu_timer(const char* name);
+		VKR_API void end_gpu_timer();
+
+		/* The timers of the last frame the GPU finished, which lags the
+		 * one being recorded by the frames in flight, in the order that
+		 * they began. Empty without support for timestamps. */
+		inline const std::vector<GPUTiming>& get_gpu_timings() const { return gpu_timings; }
+
+		/* The swapchain is recreated at the next begin. In threaded frame
+		 * mode, this must be called from App::on_snapshot. */
+		VKR_API void set_present_mode(PresentMode mode);
+		inline PresentMode get_present_mode() const { return present_mode; }
+
 		inline bool are_validation_layers_enabled() const { return validation_layers_enabled; }
+
+		/* Without a window, surface or swapchain; see App::headless. */
+		inline bool is_headless() const { return headless; }
+
+		/* Headless framebuffers keep a copy of their attachments for each
+		 * frame in flight; these identify the copy being rendered to. */
+		VKR_API u32 get_frames_in_flight() const;
+		inline u32 get_current_frame() const { return current_frame; }
+		inline bool is_frame_skipped() const { return skip_frame; }
+
+		/* Walks every allocation, so it's too slow to call every frame. */
+		VKR_API MemoryUsage get_memory_usage() const;
 	};
 
 	class VKR_API Shader {
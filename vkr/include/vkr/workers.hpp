@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
+
+namespace vkr {
+	/* A fixed set of threads that sleep until they are handed work.
+	 *
+	 * run splits a batch of jobs between the workers and the calling
+	 * thread and returns once all of them have finished, so the threads
+	 * are only started once rather than for every batch. Batches from
+	 * several threads may be in flight at once; each is worked on by
+	 * whichever threads are free. */
+	class VKR_API WorkerPool {
+	private:
+		struct Batch {
+			const std::function<void(usize)>* f;
+			usize count;
+			std::atomic<usize> next;
+			usize workers; /* Threads other than the caller working on it. */
+		};
+
+		std::vector<std::thread> threads;
+
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::condition_variable finished;
+		std::deque<Batch*> queue;
+		bool quit;
+
+		void work(Batch* batch);
+		void worker_main();
+	public:
+		/* Zero threads means as many as the hardware supports. The thread
+		 * calling run counts as one of them, so a pool of one thread starts
+		 * no workers and runs everything on the caller. */
+		WorkerPool(usize thread_count = 0);
+		~WorkerPool();
+
+		WorkerPool(const WorkerPool&) = delete;
+		WorkerPool& operator=(const WorkerPool&) = delete;
+
+		/* Calls f(i) for every i in [0, count), in no particular order. */
+		void run(usize count, const std::function<void(usize)>& f);
+
+		inline usize get_thread_count() const { return threads.size() + 1; }
+	};
+}
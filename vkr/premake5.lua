@@ -75,6 +75,14 @@ project "vkr"
 			"_CRT_SECURE_NO_WARNINGS"
 		}
 
+	filter "options:avx"
+		vectorextensions "AVX"
+
+	filter "options:profile"
+		defines {
+			"VKR_PROFILE"
+		}
+
 	filter "configurations:debug"
 		runtime "debug"
 		symbols "on"
@@ -1,10 +1,17 @@
+#include <math.h>
 #include <time.h>
 #include <stdlib.h>
 
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #include <GLFW/glfw3.h>
 
 #include "vkr.hpp"
 #include "internal.hpp"
+#include "profiler.hpp"
 
 namespace vkr {
 	struct impl_App {
@@ -45,7 +52,14 @@ namespace vkr {
 		app->mouse_pos = v2i(static_cast<i32>(x), static_cast<i32>(y));
 	}
 
-	App::App(const char* title, v2i size) : handle(null), title(title), size(size) {
+	/* In seconds. GLFW's timer isn't used as headless apps don't
+	 * initialise GLFW. */
+	static f64 get_time() {
+		return std::chrono::duration<f64>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	App::App(const char* title, v2i size) : handle(null), title(title), size(size), threaded_frames(false),
+		fixed_timestep(0.0), max_fixed_updates(8), interpolation_alpha(0.0), max_frame_rate(0.0), headless(false) {
 		/* Setup keybinds. Because my autism won't let me make the user include glfw3.h. */
 		keymap[GLFW_KEY_UNKNOWN]       = key_unknown;
 		keymap[GLFW_KEY_SPACE]         = key_space;
@@ -139,10 +153,9 @@ namespace vkr {
 		srand(static_cast<u32>(time(0)));
 
 		handle = new impl_App();
+		handle->window = null;
 
-		glfwInit();
-
-		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+		quit_requested = false;
 
 		bool enable_validation_layers = 
 #ifdef DEBUG
@@ -153,20 +166,32 @@ namespace vkr {
 		;
 
 		u32 ext_count = 0;
-		const char** exts = glfwGetRequiredInstanceExtensions(&ext_count);
+		const char** exts = null;
+
+		/* Headless apps don't touch GLFW at all, as it can't initialise
+		 * without a display to connect to. */
+		if (!headless) {
+			glfwInit();
 
-		handle->window = glfwCreateWindow(size.x, size.y, title, null, null);
-		if (!handle->window) {
-			abort_with("Failed to create window.");
+			glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+
+			exts = glfwGetRequiredInstanceExtensions(&ext_count);
+
+			handle->window = glfwCreateWindow(size.x, size.y, title, null, null);
+			if (!handle->window) {
+				abort_with("Failed to create window.");
+			}
 		}
 
 		video = new VideoContext(*this, title, enable_validation_layers, ext_count, exts);
 
-		glfwSetWindowUserPointer(handle->window, this);
-		glfwSetFramebufferSizeCallback(handle->window, on_framebuffer_resize);
-		glfwSetKeyCallback(handle->window, on_key_event);
-		glfwSetMouseButtonCallback(handle->window, on_mouse_button_event);
-		glfwSetCursorPosCallback(handle->window, on_mouse_move);
+		if (!headless) {
+			glfwSetWindowUserPointer(handle->window, this);
+			glfwSetFramebufferSizeCallback(handle->window, on_framebuffer_resize);
+			glfwSetKeyCallback(handle->window, on_key_event);
+			glfwSetMouseButtonCallback(handle->window, on_mouse_button_event);
+			glfwSetCursorPosCallback(handle->window, on_mouse_move);
+		}
 
 		memset(pressed_keys,  0, static_cast<usize>(key_count) * sizeof(bool));
 		memset(released_keys, 0, static_cast<usize>(key_count) * sizeof(bool));
@@ -177,52 +202,282 @@ namespace vkr {
 
 		on_init();
 
-		f64 now = glfwGetTime(), last = now;
+		f64 now = get_time(), last = now;
 		f64 ts = 0.0;
+		f64 accumulator = 0.0;
 
-		while (!glfwWindowShouldClose(handle->window)) {
+		/* Published as interpolation_alpha just before on_snapshot, rather
+		 * than in update, which in threaded mode runs alongside on_render
+		 * and belongs to the next frame. */
+		f64 alpha = 0.0;
+
+		/* The just pressed and just released states are only cleared once
+		 * an update has seen them, as with a fixed timestep a frame can go
+		 * by without one. */
+		bool input_seen = true;
+
+		auto clear_input_edges = [this]() {
 			memset(pressed_keys,  0, static_cast<usize>(key_count) * sizeof(bool));
 			memset(released_keys, 0, static_cast<usize>(key_count) * sizeof(bool));
 			memset(pressed_mouse_buttons,  0, static_cast<usize>(mouse_button_count) * sizeof(bool));
 			memset(released_mouse_buttons, 0, static_cast<usize>(mouse_button_count) * sizeof(bool));
+		};
 
-			glfwPollEvents();
+		auto update = [&]() {
+			profile_scope("App::update");
 
-			while (video->want_recreate && (size.x == 0 || size.y == 0)) {
-				glfwGetFramebufferSize(handle->window, &size.x, &size.y);
-				glfwWaitEvents();
+			if (fixed_timestep <= 0.0) {
+				on_update(ts);
+				input_seen = true;
+				return;
 			}
 
-			video->begin();
-			on_update(ts);
-			video->end();
+			accumulator += ts;
+
+			u32 steps = 0;
+			for (; accumulator >= fixed_timestep && steps < max_fixed_updates; steps++) {
+				if (steps > 0) {
+					clear_input_edges();
+				}
+
+				on_update(fixed_timestep);
+				accumulator -= fixed_timestep;
+			}
+
+			if (accumulator >= fixed_timestep) {
+				accumulator = fmod(accumulator, fixed_timestep);
+			}
+
+			alpha = accumulator / fixed_timestep;
+			input_seen = input_seen || steps > 0;
+		};
+
+		/* With threaded_frames, draws frame N from its snapshot while the
+		 * main thread updates frame N + 1. Events are only polled while it
+		 * is stopped, as they can resize the swapchain. It is started the
+		 * first time it's needed and sleeps between frames; render_pending
+		 * is set when a snapshot is ready and cleared once it's presented. */
+		std::thread render_thread;
+		std::mutex render_mutex;
+		std::condition_variable render_cv;
+		bool render_pending = false;
+		bool render_quit = false;
+
+		auto render_main = [&]() {
+			std::unique_lock<std::mutex> lock(render_mutex);
+
+			for (;;) {
+				render_cv.wait(lock, [&]() { return render_pending || render_quit; });
+				if (render_quit) { return; }
+
+				lock.unlock();
+
+				{
+					profile_scope("App::render");
+
+					video->begin();
+					on_render();
+					video->end();
+				}
+
+				lock.lock();
+				render_pending = false;
+				render_cv.notify_all();
+			}
+		};
 
-			now = glfwGetTime();
+		auto wait_for_render = [&]() {
+			std::unique_lock<std::mutex> lock(render_mutex);
+			render_cv.wait(lock, [&]() { return !render_pending; });
+		};
+
+		while (!quit_requested && (headless || !glfwWindowShouldClose(handle->window))) {
+			profile_scope("App::run");
+
+			if (render_thread.joinable()) {
+				profile_scope("Wait for the render thread");
+				wait_for_render();
+			}
+
+			if (input_seen) {
+				clear_input_edges();
+				input_seen = false;
+			}
+
+			if (!headless) {
+				glfwPollEvents();
+
+				while (video->want_recreate && (size.x == 0 || size.y == 0)) {
+					glfwGetFramebufferSize(handle->window, &size.x, &size.y);
+					glfwWaitEvents();
+				}
+			}
+
+			if (threaded_frames) {
+				interpolation_alpha = alpha;
+				on_snapshot();
+
+				if (!render_thread.joinable()) {
+					render_thread = std::thread(render_main);
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(render_mutex);
+					render_pending = true;
+				}
+
+				render_cv.notify_all();
+
+				update();
+			} else {
+				video->begin();
+				update();
+				interpolation_alpha = alpha;
+				on_snapshot();
+				on_render();
+				video->end();
+			}
+
+			if (max_frame_rate > 0.0) {
+				/* Sleep for most of the wait, as sleeps can overshoot by a
+				 * good millisecond or two, and spin for the rest. */
+				const f64 until = last + 1.0 / max_frame_rate;
+				for (f64 t = get_time(); t < until; t = get_time()) {
+					if (until - t > 0.002) {
+						std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					} else {
+						std::this_thread::yield();
+					}
+				}
+			}
+
+			now = get_time();
 			ts = now - last;
 			last = now;
+
+			frame_times.add(ts);
+		}
+
+		if (render_thread.joinable()) {
+			wait_for_render();
+
+			{
+				std::lock_guard<std::mutex> lock(render_mutex);
+				render_quit = true;
+			}
+
+			render_cv.notify_all();
+			render_thread.join();
 		}
 
 		on_deinit();
 
 		video->wait_for_done();
 
-		glfwDestroyWindow(handle->window);
+		if (!headless) {
+			glfwDestroyWindow(handle->window);
+		}
 
 		delete video;
 
-		glfwTerminate();
+		if (!headless) {
+			glfwTerminate();
+		}
 
 		delete handle;
 	}
 
+	FrameTimeHistogram::FrameTimeHistogram() {
+		reset();
+	}
+
+	void FrameTimeHistogram::add(f64 seconds) {
+		usize bucket = static_cast<usize>(seconds / bucket_width);
+		if (bucket > bucket_count) {
+			bucket = bucket_count;
+		}
+
+		buckets[bucket]++;
+
+		min = count > 0 && min < seconds ? min : seconds;
+		max = max > seconds ? max : seconds;
+		total += seconds;
+		count++;
+	}
+
+	void FrameTimeHistogram::reset() {
+		memset(buckets, 0, sizeof(buckets));
+		count = 0;
+		total = 0.0;
+		min = 0.0;
+		max = 0.0;
+	}
+
+	f64 FrameTimeHistogram::percentile(f64 p) const {
+		if (count == 0) { return 0.0; }
+
+		usize target = static_cast<usize>(ceil(p * (f64)count));
+		if (target < 1) { target = 1; }
+
+		usize seen = 0;
+		for (usize i = 0; i < bucket_count; i++) {
+			seen += buckets[i];
+			if (seen >= target) {
+				return (f64)(i + 1) * bucket_width;
+			}
+		}
+
+		/* In the overflow bucket. */
+		return max;
+	}
+
+	void FrameTimeHistogram::print() const {
+		info("Frame times over %llu frames: mean %.2fms, min %.2fms, max %.2fms; 50%% %.2fms, 95%% %.2fms, 99%% %.2fms.",
+			(unsigned long long)count, get_mean() * 1000.0, get_min() * 1000.0, max * 1000.0,
+			percentile(0.5) * 1000.0, percentile(0.95) * 1000.0, percentile(0.99) * 1000.0);
+
+		if (count == 0) { return; }
+
+		/* A bar per millisecond, skipping empty ones. */
+		const usize per_ms = static_cast<usize>(0.001 / bucket_width + 0.5);
+		for (usize i = 0; i < bucket_count; i += per_ms) {
+			usize n = 0;
+			for (usize j = i; j < i + per_ms; j++) {
+				n += buckets[j];
+			}
+
+			if (n == 0) { continue; }
+
+			char bar[51];
+			usize len = (n * 50 + count - 1) / count;
+			memset(bar, '#', len);
+			bar[len] = '\0';
+
+			info("%3llu-%3llums %6llu %s", (unsigned long long)(i / per_ms), (unsigned long long)(i / per_ms + 1),
+				(unsigned long long)n, bar);
+		}
+
+		if (buckets[bucket_count] > 0) {
+			info("  >%3llums %6llu", (unsigned long long)(bucket_count / per_ms), (unsigned long long)buckets[bucket_count]);
+		}
+	}
+
 	void App::lock_mouse() {
+		if (!handle->window) { return; }
+
 		glfwSetInputMode(handle->window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 	}
 
 	void App::unlock_mouse() {
+		if (!handle->window) { return; }
+
 		glfwSetInputMode(handle->window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
 	}
 
+	void App::quit() {
+		quit_requested = true;
+	}
+
 	bool App::create_window_surface(const VideoContext& ctx) const {
 		return glfwCreateWindowSurface(ctx.handle->instance, handle->window, null, &ctx.handle->surface) == VK_SUCCESS;
 	}
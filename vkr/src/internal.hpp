@@ -1,3 +1,5 @@
+#include <atomic>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -8,7 +10,101 @@
 
 #define max_frames_in_flight 3
 
+/* Size of each frame's uniform ring buffer, in bytes. */
+#define uniform_ring_size (8 * 1024 * 1024)
+
+/* How many frames a pointer can go without being uploaded before its
+ * slot in the uniform ring is given up. */
+#define uniform_slot_max_idle_frames 16
+
+/* Where compiled pipelines are kept between runs, relative to the
+ * working directory. */
+#define pipeline_cache_path "pipeline_cache.bin"
+
+/* Timestamps each frame can write; two per GPU timer. */
+#define max_gpu_timestamps 256
+
 namespace vkr {
+	/* Uniform and storage buffer contents live in a persistently mapped
+	 * buffer per frame in flight, and are bound with dynamic offsets.
+	 *
+	 * Each pointer that is uploaded from gets a slot of its own, at the
+	 * same offset in every frame's buffer, allocated down from the top.
+	 * A frame's slot is only written when what it holds is out of date,
+	 * so data that doesn't change stops being copied once every frame's
+	 * buffer has it. Uploads from a pointer after its first in a frame
+	 * with different data can't overwrite the slot, as it may already be
+	 * bound; those are bump allocated up from the bottom instead, and
+	 * that part is reset when the frame begins. */
+	struct impl_UniformRing {
+		VkBuffer buffers[max_frames_in_flight];
+		VmaAllocation memories[max_frames_in_flight];
+		u8* datas[max_frames_in_flight];
+
+		usize offset;    /* Of the bump allocated part. */
+		usize slot_base; /* The lowest slot. */
+		usize alignment;
+
+		struct Slot {
+			usize offset;
+			usize capacity;
+		};
+
+		struct Entry {
+			Slot slot;
+
+			/* The last data uploaded from the pointer, to compare against
+			 * in ordinary memory, as reading back from the mapped buffer
+			 * can be very slow. Every change bumps the version. */
+			u8* contents;
+			usize size;
+			u64 version;
+
+			u64 written[max_frames_in_flight]; /* The version in each frame's slot. */
+
+			u64 last_frame;        /* Of the last upload. */
+			usize current_offset;  /* Of contents, in this frame's buffer. */
+		};
+
+		std::unordered_map<const void*, Entry> entries;
+
+		/* Slots given up during a frame can still be bound in it, so they
+		 * are only reused from the next one. */
+		std::vector<Slot> free_slots;
+		std::vector<Slot> released_slots;
+
+		u64 frame;
+
+		/* Pipelines can begin on several threads at once when recording
+		 * command lists. */
+		std::mutex mutex;
+	};
+
+	/* A timestamp query pool per frame in flight. A frame's timestamps
+	 * are only read back once its fence has been waited on again, so the
+	 * read never stalls and the results lag max_frames_in_flight frames
+	 * behind. */
+	struct impl_GPUTimers {
+		VkQueryPool pools[max_frames_in_flight];
+		u32 query_counts[max_frames_in_flight];
+
+		struct Scope {
+			const char* name;
+			u32 depth;
+			u32 begin, end; /* Queries in the pool. */
+		};
+
+		std::vector<Scope> scopes[max_frames_in_flight];
+
+		/* Timers begun but not ended in the frame being recorded, as
+		 * indices into its scopes. */
+		std::vector<usize> open;
+
+		f64 period; /* Nanoseconds per tick. */
+		bool supported;
+		bool active; /* Latched from VideoContext::gpu_timers at begin. */
+	};
+
 	struct impl_VideoContext {
 		VkInstance instance;
 		VkPhysicalDevice pdevice;
@@ -32,6 +128,7 @@ namespace vkr {
 		VkExtent2D swapchain_extent;
 
 		/* Command buffer */
+		u32 graphics_family;
 		VkCommandPool command_pool;
 		VkCommandBuffer command_buffers[max_frames_in_flight];
 
@@ -41,6 +138,14 @@ namespace vkr {
 		VkFence in_flight_fences[max_frames_in_flight];             /* Waits for the last frame to finish. */
 
 		VkDebugUtilsMessengerEXT messenger;
+
+		impl_UniformRing uniform_ring;
+
+		/* Shared by every pipeline, so that re-creating them on resize or
+		 * on the next run doesn't compile the shaders again. */
+		VkPipelineCache pipeline_cache;
+
+		impl_GPUTimers gpu_timers;
 	};
 
 	struct impl_Buffer {
@@ -64,14 +169,27 @@ namespace vkr {
 	struct impl_DescriptorSet {
 		VkDescriptorSetLayout layout;
 		VkDescriptorSet       sets[max_frames_in_flight];
+
+		/* Indices into impl_Pipeline::uniforms, in binding order, which
+		 * is the order the dynamic offsets are passed in. */
+		usize* dynamic_uniforms;
+		usize dynamic_count;
 	};
 
 	struct impl_UniformBuffer {
-		VkBuffer buffers[max_frames_in_flight];
-		VmaAllocation memories[max_frames_in_flight];
-
 		void* ptr;
 		usize size;
+		const usize* used_size; /* Only for storage buffers; see ResourcePointer. */
+
+		/* Offset into the uniform ring for the current frame. Atomic, as
+		 * the same pipeline may be begun in command lists on several
+		 * threads; they all get the same offset for the same data. */
+		std::atomic<u32> offset;
+	};
+
+	struct impl_CommandList {
+		VkCommandPool pool;
+		VkCommandBuffer buffers[max_frames_in_flight];
 	};
 
 	struct impl_Pipeline {
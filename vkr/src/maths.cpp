@@ -1,6 +1,171 @@
 #include "vkr.hpp"
+#include "simd.hpp"
 
 namespace vkr {
+	namespace scalar {
+		m4f mul(const m4f& a, const m4f& b) {
+			m4f r(1.0f);
+
+			r.m[0][0] = a.m[0][0] * b.m[0][0] + a.m[1][0] * b.m[0][1] + a.m[2][0] * b.m[0][2] + a.m[3][0] * b.m[0][3];
+			r.m[1][0] = a.m[0][0] * b.m[1][0] + a.m[1][0] * b.m[1][1] + a.m[2][0] * b.m[1][2] + a.m[3][0] * b.m[1][3];
+			r.m[2][0] = a.m[0][0] * b.m[2][0] + a.m[1][0] * b.m[2][1] + a.m[2][0] * b.m[2][2] + a.m[3][0] * b.m[2][3];
+			r.m[3][0] = a.m[0][0] * b.m[3][0] + a.m[1][0] * b.m[3][1] + a.m[2][0] * b.m[3][2] + a.m[3][0] * b.m[3][3];
+			r.m[0][1] = a.m[0][1] * b.m[0][0] + a.m[1][1] * b.m[0][1] + a.m[2][1] * b.m[0][2] + a.m[3][1] * b.m[0][3];
+			r.m[1][1] = a.m[0][1] * b.m[1][0] + a.m[1][1] * b.m[1][1] + a.m[2][1] * b.m[1][2] + a.m[3][1] * b.m[1][3];
+			r.m[2][1] = a.m[0][1] * b.m[2][0] + a.m[1][1] * b.m[2][1] + a.m[2][1] * b.m[2][2] + a.m[3][1] * b.m[2][3];
+			r.m[3][1] = a.m[0][1] * b.m[3][0] + a.m[1][1] * b.m[3][1] + a.m[2][1] * b.m[3][2] + a.m[3][1] * b.m[3][3];
+			r.m[0][2] = a.m[0][2] * b.m[0][0] + a.m[1][2] * b.m[0][1] + a.m[2][2] * b.m[0][2] + a.m[3][2] * b.m[0][3];
+			r.m[1][2] = a.m[0][2] * b.m[1][0] + a.m[1][2] * b.m[1][1] + a.m[2][2] * b.m[1][2] + a.m[3][2] * b.m[1][3];
+			r.m[2][2] = a.m[0][2] * b.m[2][0] + a.m[1][2] * b.m[2][1] + a.m[2][2] * b.m[2][2] + a.m[3][2] * b.m[2][3];
+			r.m[3][2] = a.m[0][2] * b.m[3][0] + a.m[1][2] * b.m[3][1] + a.m[2][2] * b.m[3][2] + a.m[3][2] * b.m[3][3];
+			r.m[0][3] = a.m[0][3] * b.m[0][0] + a.m[1][3] * b.m[0][1] + a.m[2][3] * b.m[0][2] + a.m[3][3] * b.m[0][3];
+			r.m[1][3] = a.m[0][3] * b.m[1][0] + a.m[1][3] * b.m[1][1] + a.m[2][3] * b.m[1][2] + a.m[3][3] * b.m[1][3];
+			r.m[2][3] = a.m[0][3] * b.m[2][0] + a.m[1][3] * b.m[2][1] + a.m[2][3] * b.m[2][2] + a.m[3][3] * b.m[2][3];
+			r.m[3][3] = a.m[0][3] * b.m[3][0] + a.m[1][3] * b.m[3][1] + a.m[2][3] * b.m[3][2] + a.m[3][3] * b.m[3][3];
+
+			return r;
+		}
+
+		m4f inverse(const m4f& in) {
+			const f32* mm = (const f32*)in.m;
+
+			f32 t0 = mm[10] * mm[15];
+			f32 t1 = mm[14] * mm[11];
+			f32 t2 = mm[6] * mm[15];
+			f32 t3 = mm[14] * mm[7];
+			f32 t4 = mm[6] * mm[11];
+			f32 t5 = mm[10] * mm[7];
+			f32 t6 = mm[2] * mm[15];
+			f32 t7 = mm[14] * mm[3];
+			f32 t8 = mm[2] * mm[11];
+			f32 t9 = mm[10] * mm[3];
+			f32 t10 = mm[2] * mm[7];
+			f32 t11 = mm[6] * mm[3];
+			f32 t12 = mm[8] * mm[13];
+			f32 t13 = mm[12] * mm[9];
+			f32 t14 = mm[4] * mm[13];
+			f32 t15 = mm[12] * mm[5];
+			f32 t16 = mm[4] * mm[9];
+			f32 t17 = mm[8] * mm[5];
+			f32 t18 = mm[0] * mm[13];
+			f32 t19 = mm[12] * mm[1];
+			f32 t20 = mm[0] * mm[9];
+			f32 t21 = mm[8] * mm[1];
+			f32 t22 = mm[0] * mm[5];
+			f32 t23 = mm[4] * mm[1];
+
+			m4f r(1.0f);
+			f32* o = (f32*)r.m;
+
+			o[0] = (t0 * mm[5] + t3 * mm[9] + t4 * mm[13]) - (t1 * mm[5] + t2 * mm[9] + t5 * mm[13]);
+			o[1] = (t1 * mm[1] + t6 * mm[9] + t9 * mm[13]) - (t0 * mm[1] + t7 * mm[9] + t8 * mm[13]);
+			o[2] = (t2 * mm[1] + t7 * mm[5] + t10 * mm[13]) - (t3 * mm[1] + t6 * mm[5] + t11 * mm[13]);
+			o[3] = (t5 * mm[1] + t8 * mm[5] + t11 * mm[9]) - (t4 * mm[1] + t9 * mm[5] + t10 * mm[9]);
+
+			f32 d = 1.0f / (mm[0] * o[0] + mm[4] * o[1] + mm[8] * o[2] + mm[12] * o[3]);
+
+			o[0] = d * o[0];
+			o[1] = d * o[1];
+			o[2] = d * o[2];
+			o[3] = d * o[3];
+			o[4] = d * ((t1 * mm[4] + t2 * mm[8] + t5 * mm[12]) - (t0 * mm[4] + t3 * mm[8] + t4 * mm[12]));
+			o[5] = d * ((t0 * mm[0] + t7 * mm[8] + t8 * mm[12]) - (t1 * mm[0] + t6 * mm[8] + t9 * mm[12]));
+			o[6] = d * ((t3 * mm[0] + t6 * mm[4] + t11 * mm[12]) - (t2 * mm[0] + t7 * mm[4] + t10 * mm[12]));
+			o[7] = d * ((t4 * mm[0] + t9 * mm[4] + t10 * mm[8]) - (t5 * mm[0] + t8 * mm[4] + t11 * mm[8]));
+			o[8] = d * ((t12 * mm[7] + t15 * mm[11] + t16 * mm[15]) - (t13 * mm[7] + t14 * mm[11] + t17 * mm[15]));
+			o[9] = d * ((t13 * mm[3] + t18 * mm[11] + t21 * mm[15]) - (t12 * mm[3] + t19 * mm[11] + t20 * mm[15]));
+			o[10] = d * ((t14 * mm[3] + t19 * mm[7] + t22 * mm[15]) - (t15 * mm[3] + t18 * mm[7] + t23 * mm[15]));
+			o[11] = d * ((t17 * mm[3] + t20 * mm[7] + t23 * mm[11]) - (t16 * mm[3] + t21 * mm[7] + t22 * mm[11]));
+			o[12] = d * ((t14 * mm[10] + t17 * mm[14] + t13 * mm[6]) - (t16 * mm[14] + t12 * mm[6] + t15 * mm[10]));
+			o[13] = d * ((t20 * mm[14] + t12 * mm[2] + t19 * mm[10]) - (t18 * mm[10] + t21 * mm[14] + t13 * mm[2]));
+			o[14] = d * ((t18 * mm[6] + t23 * mm[14] + t15 * mm[2]) - (t22 * mm[14] + t14 * mm[2] + t19 * mm[6]));
+			o[15] = d * ((t22 * mm[10] + t16 * mm[2] + t21 * mm[6]) - (t20 * mm[6] + t23 * mm[10] + t17 * mm[2]));
+
+			return r;
+		}
+
+		m4f transposed(const m4f& in) {
+			m4f r(1.0f);
+
+			r.m[0][0] = in.m[0][0];
+			r.m[1][0] = in.m[0][1];
+			r.m[2][0] = in.m[0][2];
+			r.m[3][0] = in.m[0][3];
+			r.m[0][1] = in.m[1][0];
+			r.m[1][1] = in.m[1][1];
+			r.m[2][1] = in.m[1][2];
+			r.m[3][1] = in.m[1][3];
+			r.m[0][2] = in.m[2][0];
+			r.m[1][2] = in.m[2][1];
+			r.m[2][2] = in.m[2][2];
+			r.m[3][2] = in.m[2][3];
+			r.m[0][3] = in.m[3][0];
+			r.m[1][3] = in.m[3][1];
+			r.m[2][3] = in.m[3][2];
+			r.m[3][3] = in.m[3][3];
+
+			return r;
+		}
+
+		v4f transform(const m4f& m, v4f v) {
+			return v4f(
+				m.m[0][0] * v.x + m.m[1][0] * v.y + m.m[2][0] * v.z + m.m[3][0] * v.w,
+				m.m[0][1] * v.x + m.m[1][1] * v.y + m.m[2][1] * v.z + m.m[3][1] * v.w,
+				m.m[0][2] * v.x + m.m[1][2] * v.y + m.m[2][2] * v.z + m.m[3][2] * v.w,
+				m.m[0][3] * v.x + m.m[1][3] * v.y + m.m[2][3] * v.z + m.m[3][3] * v.w);
+		}
+
+		AABB transform(const m4f& m, const AABB& aabb) {
+			v3f corners[] = {
+				aabb.min,
+				v3f(aabb.min.x, aabb.max.y, aabb.min.z),
+				v3f(aabb.min.x, aabb.max.y, aabb.max.z),
+				v3f(aabb.min.x, aabb.min.y, aabb.max.z),
+				v3f(aabb.max.x, aabb.min.y, aabb.min.z),
+				v3f(aabb.max.x, aabb.max.y, aabb.min.z),
+				aabb.max,
+				v3f(aabb.max.x, aabb.min.y, aabb.max.z)
+			};
+
+			AABB result = {
+				.min = { INFINITY, INFINITY, INFINITY },
+				.max = { -INFINITY, -INFINITY, -INFINITY }
+			};
+
+			for (u32 i = 0; i < 8; i++) {
+				v4f point = transform(m, v4f(corners[i].x, corners[i].y, corners[i].z, 1.0f));
+
+				result.min.x = std::min(result.min.x, point.x);
+				result.min.y = std::min(result.min.y, point.y);
+				result.min.z = std::min(result.min.z, point.z);
+				result.max.x = std::max(result.max.x, point.x);
+				result.max.y = std::max(result.max.y, point.y);
+				result.max.z = std::max(result.max.z, point.z);
+			}
+
+			return result;
+		}
+
+		void transform_points(const m4f& m, const v3f* in, v3f* out, usize count) {
+			for (usize i = 0; i < count; i++) {
+				v4f p = transform(m, v4f(in[i].x, in[i].y, in[i].z, 1.0f));
+				out[i] = v3f(p.x, p.y, p.z);
+			}
+		}
+
+		void transform_aabbs(const m4f* ms, const AABB* aabbs, AABB* out, usize count) {
+			for (usize i = 0; i < count; i++) {
+				out[i] = transform(ms[i], aabbs[i]);
+			}
+		}
+
+		void mul_matrices(const m4f* a, const m4f* b, m4f* out, usize count) {
+			for (usize i = 0; i < count; i++) {
+				out[i] = mul(a[i], b[i]);
+			}
+		}
+	}
+
 	m4f::m4f() {}
 	
 	m4f::m4f(f32 d) {
@@ -31,35 +196,8 @@ namespace vkr {
 		return r;
 	}
 
-	m4f m4f::operator*(const m4f& other) const {
-		m4f r(1.0f);
-
-		r.m[0][0] = m[0][0] * other.m[0][0] + m[1][0] * other.m[0][1] + m[2][0] * other.m[0][2] + m[3][0] * other.m[0][3];
-		r.m[1][0] = m[0][0] * other.m[1][0] + m[1][0] * other.m[1][1] + m[2][0] * other.m[1][2] + m[3][0] * other.m[1][3];
-		r.m[2][0] = m[0][0] * other.m[2][0] + m[1][0] * other.m[2][1] + m[2][0] * other.m[2][2] + m[3][0] * other.m[2][3];
-		r.m[3][0] = m[0][0] * other.m[3][0] + m[1][0] * other.m[3][1] + m[2][0] * other.m[3][2] + m[3][0] * other.m[3][3];
-		r.m[0][1] = m[0][1] * other.m[0][0] + m[1][1] * other.m[0][1] + m[2][1] * other.m[0][2] + m[3][1] * other.m[0][3];
-		r.m[1][1] = m[0][1] * other.m[1][0] + m[1][1] * other.m[1][1] + m[2][1] * other.m[1][2] + m[3][1] * other.m[1][3];
-		r.m[2][1] = m[0][1] * other.m[2][0] + m[1][1] * other.m[2][1] + m[2][1] * other.m[2][2] + m[3][1] * other.m[2][3];
-		r.m[3][1] = m[0][1] * other.m[3][0] + m[1][1] * other.m[3][1] + m[2][1] * other.m[3][2] + m[3][1] * other.m[3][3];
-		r.m[0][2] = m[0][2] * other.m[0][0] + m[1][2] * other.m[0][1] + m[2][2] * other.m[0][2] + m[3][2] * other.m[0][3];
-		r.m[1][2] = m[0][2] * other.m[1][0] + m[1][2] * other.m[1][1] + m[2][2] * other.m[1][2] + m[3][2] * other.m[1][3];
-		r.m[2][2] = m[0][2] * other.m[2][0] + m[1][2] * other.m[2][1] + m[2][2] * other.m[2][2] + m[3][2] * other.m[2][3];
-		r.m[3][2] = m[0][2] * other.m[3][0] + m[1][2] * other.m[3][1] + m[2][2] * other.m[3][2] + m[3][2] * other.m[3][3];
-		r.m[0][3] = m[0][3] * other.m[0][0] + m[1][3] * other.m[0][1] + m[2][3] * other.m[0][2] + m[3][3] * other.m[0][3];
-		r.m[1][3] = m[0][3] * other.m[1][0] + m[1][3] * other.m[1][1] + m[2][3] * other.m[1][2] + m[3][3] * other.m[1][3];
-		r.m[2][3] = m[0][3] * other.m[2][0] + m[1][3] * other.m[2][1] + m[2][3] * other.m[2][2] + m[3][3] * other.m[2][3];
-		r.m[3][3] = m[0][3] * other.m[3][0] + m[1][3] * other.m[3][1] + m[2][3] * other.m[3][2] + m[3][3] * other.m[3][3];
-
-		return r;
-	}
-
 	v4f m4f::operator*(const v4f& other) const {
-		return v4f(
-			m[0][0] * other.x + m[1][0] * other.y + m[2][0] * other.z + m[3][0] + other.w,
-			m[0][1] * other.x + m[1][1] * other.y + m[2][1] * other.z + m[3][1] + other.w,
-			m[0][2] * other.x + m[1][2] * other.y + m[2][2] * other.z + m[3][2] + other.w,
-			m[0][3] * other.x + m[1][3] * other.y + m[2][3] * other.z + m[3][3] + other.w);
+		return transform(*this, other);
 	}
 
 	m4f m4f::translate(m4f m, v3f v) {
@@ -176,123 +314,298 @@ namespace vkr {
 		return res;
 	}
 
+	Frustum Frustum::from_matrix(const m4f& vp) {
+		Frustum f;
+
+		v4f rows[4];
+		for (u32 i = 0; i < 4; i++) {
+			rows[i] = v4f(vp.m[0][i], vp.m[1][i], vp.m[2][i], vp.m[3][i]);
+		}
+
+		f.planes[0] = rows[3] + rows[0]; /* Left. */
+		f.planes[1] = rows[3] - rows[0]; /* Right. */
+		f.planes[2] = rows[3] + rows[1]; /* Bottom. */
+		f.planes[3] = rows[3] - rows[1]; /* Top. */
+		f.planes[4] = rows[2];           /* Near. */
+		f.planes[5] = rows[3] - rows[2]; /* Far. */
+
+		for (u32 i = 0; i < 6; i++) {
+			f32 len = v3f::mag(v3f(f.planes[i].x, f.planes[i].y, f.planes[i].z));
+			f.planes[i] = f.planes[i] / len;
+		}
+
+		return f;
+	}
+
+	bool Frustum::contains_sphere(v3f c, f32 r) const {
+		for (u32 i = 0; i < 6; i++) {
+			const v4f& p = planes[i];
+			if (p.x * c.x + p.y * c.y + p.z * c.z + p.w < -r) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool Frustum::contains_aabb(const AABB& aabb) const {
+		for (u32 i = 0; i < 6; i++) {
+			const v4f& p = planes[i];
+
+			/* The corner furthest along the plane's normal. */
+			v3f v(
+				p.x >= 0.0f ? aabb.max.x : aabb.min.x,
+				p.y >= 0.0f ? aabb.max.y : aabb.min.y,
+				p.z >= 0.0f ? aabb.max.z : aabb.min.z);
+
+			if (p.x * v.x + p.y * v.y + p.z * v.z + p.w < 0.0f) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+#ifdef VKR_SIMD_NONE
+	m4f m4f::operator*(const m4f& other) const {
+		return scalar::mul(*this, other);
+	}
+
 	m4f m4f::inverse() {
-		const f32* mm = (f32*)m;
-
-		f32 t0 = mm[10] * mm[15];
-		f32 t1 = mm[14] * mm[11];
-		f32 t2 = mm[6] * mm[15];
-		f32 t3 = mm[14] * mm[7];
-		f32 t4 = mm[6] * mm[11];
-		f32 t5 = mm[10] * mm[7];
-		f32 t6 = mm[2] * mm[15];
-		f32 t7 = mm[14] * mm[3];
-		f32 t8 = mm[2] * mm[11];
-		f32 t9 = mm[10] * mm[3];
-		f32 t10 = mm[2] * mm[7];
-		f32 t11 = mm[6] * mm[3];
-		f32 t12 = mm[8] * mm[13];
-		f32 t13 = mm[12] * mm[9];
-		f32 t14 = mm[4] * mm[13];
-		f32 t15 = mm[12] * mm[5];
-		f32 t16 = mm[4] * mm[9];
-		f32 t17 = mm[8] * mm[5];
-		f32 t18 = mm[0] * mm[13];
-		f32 t19 = mm[12] * mm[1];
-		f32 t20 = mm[0] * mm[9];
-		f32 t21 = mm[8] * mm[1];
-		f32 t22 = mm[0] * mm[5];
-		f32 t23 = mm[4] * mm[1];
+		return scalar::inverse(*this);
+	}
 
-		m4f r(1.0f);
-		f32* o = (f32*)r.m;
-
-		o[0] = (t0 * mm[5] + t3 * mm[9] + t4 * mm[13]) - (t1 * mm[5] + t2 * mm[9] + t5 * mm[13]);
-		o[1] = (t1 * mm[1] + t6 * mm[9] + t9 * mm[13]) - (t0 * mm[1] + t7 * mm[9] + t8 * mm[13]);
-		o[2] = (t2 * mm[1] + t7 * mm[5] + t10 * mm[13]) - (t3 * mm[1] + t6 * mm[5] + t11 * mm[13]);
-		o[3] = (t5 * mm[1] + t8 * mm[5] + t11 * mm[9]) - (t4 * mm[1] + t9 * mm[5] + t10 * mm[9]);
-
-		f32 d = 1.0f / (mm[0] * o[0] + mm[4] * o[1] + mm[8] * o[2] + mm[12] * o[3]);
-
-		o[0] = d * o[0];
-		o[1] = d * o[1];
-		o[2] = d * o[2];
-		o[3] = d * o[3];
-		o[4] = d * ((t1 * mm[4] + t2 * mm[8] + t5 * mm[12]) - (t0 * mm[4] + t3 * mm[8] + t4 * mm[12]));
-		o[5] = d * ((t0 * mm[0] + t7 * mm[8] + t8 * mm[12]) - (t1 * mm[0] + t6 * mm[8] + t9 * mm[12]));
-		o[6] = d * ((t3 * mm[0] + t6 * mm[4] + t11 * mm[12]) - (t2 * mm[0] + t7 * mm[4] + t10 * mm[12]));
-		o[7] = d * ((t4 * mm[0] + t9 * mm[4] + t10 * mm[8]) - (t5 * mm[0] + t8 * mm[4] + t11 * mm[8]));
-		o[8] = d * ((t12 * mm[7] + t15 * mm[11] + t16 * mm[15]) - (t13 * mm[7] + t14 * mm[11] + t17 * mm[15]));
-		o[9] = d * ((t13 * mm[3] + t18 * mm[11] + t21 * mm[15]) - (t12 * mm[3] + t19 * mm[11] + t20 * mm[15]));
-		o[10] = d * ((t14 * mm[3] + t19 * mm[7] + t22 * mm[15]) - (t15 * mm[3] + t18 * mm[7] + t23 * mm[15]));
-		o[11] = d * ((t17 * mm[3] + t20 * mm[7] + t23 * mm[11]) - (t16 * mm[3] + t21 * mm[7] + t22 * mm[11]));
-		o[12] = d * ((t14 * mm[10] + t17 * mm[14] + t13 * mm[6]) - (t16 * mm[14] + t12 * mm[6] + t15 * mm[10]));
-		o[13] = d * ((t20 * mm[14] + t12 * mm[2] + t19 * mm[10]) - (t18 * mm[10] + t21 * mm[14] + t13 * mm[2]));
-		o[14] = d * ((t18 * mm[6] + t23 * mm[14] + t15 * mm[2]) - (t22 * mm[14] + t14 * mm[2] + t19 * mm[6]));
-		o[15] = d * ((t22 * mm[10] + t16 * mm[2] + t21 * mm[6]) - (t20 * mm[6] + t23 * mm[10] + t17 * mm[2]));
+	m4f m4f::transposed() {
+		return scalar::transposed(*this);
+	}
+
+	v4f m4f::transform(m4f m, v4f v) {
+		return scalar::transform(m, v);
+	}
+
+	AABB m4f::transform(m4f m, AABB aabb) {
+		return scalar::transform(m, aabb);
+	}
+
+	void transform_points(const m4f& m, const v3f* in, v3f* out, usize count) {
+		scalar::transform_points(m, in, out, count);
+	}
+
+	void transform_aabbs(const m4f* ms, const AABB* aabbs, AABB* out, usize count) {
+		scalar::transform_aabbs(ms, aabbs, out, count);
+	}
+
+	void mul_matrices(const m4f* a, const m4f* b, m4f* out, usize count) {
+		scalar::mul_matrices(a, b, out, count);
+	}
+#else
+	using namespace simd;
+
+	static inline void mul_m4f(const m4f& a, const m4f& b, m4f& r) {
+#ifdef VKR_SIMD_AVX
+		/* Two columns of the result at a time. Shuffles on 256 bit registers
+		 * work per 128 bit lane, so each half splats its own column of b. */
+		const __m256 a0 = _mm256_broadcast_ps((const __m128*)a.m[0]);
+		const __m256 a1 = _mm256_broadcast_ps((const __m128*)a.m[1]);
+		const __m256 a2 = _mm256_broadcast_ps((const __m128*)a.m[2]);
+		const __m256 a3 = _mm256_broadcast_ps((const __m128*)a.m[3]);
+
+		for (u32 i = 0; i < 4; i += 2) {
+			const __m256 col = _mm256_loadu_ps(b.m[i]);
+
+			__m256 c = _mm256_mul_ps(a0, _mm256_shuffle_ps(col, col, _MM_SHUFFLE(0, 0, 0, 0)));
+			c = _mm256_add_ps(c, _mm256_mul_ps(a1, _mm256_shuffle_ps(col, col, _MM_SHUFFLE(1, 1, 1, 1))));
+			c = _mm256_add_ps(c, _mm256_mul_ps(a2, _mm256_shuffle_ps(col, col, _MM_SHUFFLE(2, 2, 2, 2))));
+			c = _mm256_add_ps(c, _mm256_mul_ps(a3, _mm256_shuffle_ps(col, col, _MM_SHUFFLE(3, 3, 3, 3))));
+
+			_mm256_storeu_ps(r.m[i], c);
+		}
+#else
+		const f32x4 a0 = load(a.m[0]);
+		const f32x4 a1 = load(a.m[1]);
+		const f32x4 a2 = load(a.m[2]);
+		const f32x4 a3 = load(a.m[3]);
+
+		for (u32 i = 0; i < 4; i++) {
+			const f32x4 col = load(b.m[i]);
+
+			f32x4 c = mul(a0, splat<0>(col));
+			c = madd(a1, splat<1>(col), c);
+			c = madd(a2, splat<2>(col), c);
+			c = madd(a3, splat<3>(col), c);
+
+			store(r.m[i], c);
+		}
+#endif
+	}
+
+	m4f m4f::operator*(const m4f& other) const {
+		m4f r;
+		mul_m4f(*this, other, r);
+		return r;
+	}
+
+	/* Inverse through cross products of the columns' xyz parts, as in
+	 * Lengyel's Foundations of Game Engine Development. The result is
+	 * built as rows, so it is transposed on the way out. */
+	m4f m4f::inverse() {
+		const f32x4 a = load(m[0]);
+		const f32x4 b = load(m[1]);
+		const f32x4 c = load(m[2]);
+		const f32x4 d = load(m[3]);
+
+		const f32x4 aw = splat<3>(a);
+		const f32x4 bw = splat<3>(b);
+		const f32x4 cw = splat<3>(c);
+		const f32x4 dw = splat<3>(d);
+
+		/* The w lane of all of these comes out as zero. */
+		const f32x4 s = cross(a, b);
+		const f32x4 t = cross(c, d);
+		const f32x4 u = sub(mul(a, bw), mul(b, aw));
+		const f32x4 v = sub(mul(c, dw), mul(d, cw));
+
+		const f32x4 inv_det = div(set1(1.0f), hsum(add(mul(s, v), mul(t, u))));
+
+		f32x4 r0 = add(cross(b, v), mul(t, bw));
+		f32x4 r1 = sub(cross(v, a), mul(t, aw));
+		f32x4 r2 = add(cross(d, u), mul(s, dw));
+		f32x4 r3 = sub(cross(u, c), mul(s, cw));
+
+		/* The fourth column is (-b.t, a.t, -d.s, c.s); the dot products
+		 * are done four at once by transposing the component products. */
+		f32x4 bt = mul(b, t);
+		f32x4 at = mul(a, t);
+		f32x4 ds = mul(d, s);
+		f32x4 cs = mul(c, s);
+		simd::transpose(bt, at, ds, cs);
+		const f32x4 w = mul(add(add(bt, at), add(ds, cs)), set(-1.0f, 1.0f, -1.0f, 1.0f));
+
+		simd::transpose(r0, r1, r2, r3);
+
+		m4f r;
+		store(r.m[0], mul(r0, inv_det));
+		store(r.m[1], mul(r1, inv_det));
+		store(r.m[2], mul(r2, inv_det));
+		store(r.m[3], mul(w,  inv_det));
 
 		return r;
 	}
 
 	m4f m4f::transposed() {
-		m4f r(1.0f);
+		f32x4 a = load(m[0]);
+		f32x4 b = load(m[1]);
+		f32x4 c = load(m[2]);
+		f32x4 d = load(m[3]);
 
-		r.m[0][0] = m[0][0];
-		r.m[1][0] = m[0][1];
-		r.m[2][0] = m[0][2];
-		r.m[3][0] = m[0][3];
-		r.m[0][1] = m[1][0];
-		r.m[1][1] = m[1][1];
-		r.m[2][1] = m[1][2];
-		r.m[3][1] = m[1][3];
-		r.m[0][2] = m[2][0];
-		r.m[1][2] = m[2][1];
-		r.m[2][2] = m[2][2];
-		r.m[3][2] = m[2][3];
-		r.m[0][3] = m[3][0];
-		r.m[1][3] = m[3][1];
-		r.m[2][3] = m[3][2];
-		r.m[3][3] = m[3][3];
+		simd::transpose(a, b, c, d);
+
+		m4f r;
+		store(r.m[0], a);
+		store(r.m[1], b);
+		store(r.m[2], c);
+		store(r.m[3], d);
 
 		return r;
 	}
 
 	v4f m4f::transform(m4f m, v4f v) {
-		return v4f(
-			m.m[0][0] * v.x + m.m[1][0] * v.y + m.m[2][0] * v.z + m.m[3][0] + v.w,
-			m.m[0][1] * v.x + m.m[1][1] * v.y + m.m[2][1] * v.z + m.m[3][1] + v.w,
-			m.m[0][2] * v.x + m.m[1][2] * v.y + m.m[2][2] * v.z + m.m[3][2] + v.w,
-			m.m[0][3] * v.x + m.m[1][3] * v.y + m.m[2][3] * v.z + m.m[3][3] + v.w);
+		f32x4 r = mul(load(m.m[0]), set1(v.x));
+		r = madd(load(m.m[1]), set1(v.y), r);
+		r = madd(load(m.m[2]), set1(v.z), r);
+		r = madd(load(m.m[3]), set1(v.w), r);
+
+		f32 o[4];
+		store(o, r);
+
+		return v4f(o[0], o[1], o[2], o[3]);
 	}
 
+	/* Each column contributes either its min or max scaled copy to each
+	 * bound, which gives the same box as transforming all eight corners
+	 * for affine matrices (Arvo, Graphics Gems 1990). */
 	AABB m4f::transform(m4f m, AABB aabb) {
-		v3f corners[] = {
-			aabb.min,
-			v3f(aabb.min.x, aabb.max.y, aabb.min.z),
-			v3f(aabb.min.x, aabb.max.y, aabb.max.z),
-			v3f(aabb.min.x, aabb.min.y, aabb.max.z),
-			v3f(aabb.max.x, aabb.min.y, aabb.min.z),
-			v3f(aabb.max.x, aabb.max.y, aabb.min.z),
-			aabb.max,
-			v3f(aabb.max.x, aabb.min.y, aabb.max.z)
-		};
+		f32x4 lo = load(m.m[3]);
+		f32x4 hi = lo;
+
+		const f32 mins[] = { aabb.min.x, aabb.min.y, aabb.min.z };
+		const f32 maxs[] = { aabb.max.x, aabb.max.y, aabb.max.z };
 
-		AABB result = {
-			.min = { INFINITY, INFINITY, INFINITY },
-			.max = { -INFINITY, -INFINITY, -INFINITY }
+		for (u32 i = 0; i < 3; i++) {
+			const f32x4 col = load(m.m[i]);
+			const f32x4 e = mul(col, set1(mins[i]));
+			const f32x4 f = mul(col, set1(maxs[i]));
+
+			lo = add(lo, simd::min(e, f));
+			hi = add(hi, simd::max(e, f));
+		}
+
+		f32 l[4], h[4];
+		store(l, lo);
+		store(h, hi);
+
+		return AABB {
+			.min = { l[0], l[1], l[2] },
+			.max = { h[0], h[1], h[2] }
 		};
+	}
+
+	void transform_points(const m4f& m, const v3f* in, v3f* out, usize count) {
+		const f32x4 c0 = load(m.m[0]);
+		const f32x4 c1 = load(m.m[1]);
+		const f32x4 c2 = load(m.m[2]);
+		const f32x4 c3 = load(m.m[3]);
 
-		for (u32 i = 0; i < 8; i++) {
-			v4f point = m4f::transform(m, v4f(corners[i].x, corners[i].y, corners[i].z, 0.0f));
+		for (usize i = 0; i < count; i++) {
+			f32x4 r = madd(c0, set1(in[i].x), c3);
+			r = madd(c1, set1(in[i].y), r);
+			r = madd(c2, set1(in[i].z), r);
 
-			result.min.x = std::min(result.min.x, point.x);
-			result.min.y = std::min(result.min.y, point.y);
-			result.min.z = std::min(result.min.z, point.z);
-			result.max.x = std::max(result.max.x, point.x);
-			result.max.y = std::max(result.max.y, point.y);
-			result.max.z = std::max(result.max.z, point.z);
+			store3(&out[i].x, r);
 		}
+	}
+
+	/* Transforms the centre as a point and the half extents by the
+	 * absolute value of the upper 3x3, which gives the same box as
+	 * transforming the corners for affine matrices with half the work. */
+	void transform_aabbs(const m4f* ms, const AABB* aabbs, AABB* out, usize count) {
+		const f32x4 half = set1(0.5f);
+
+		for (usize i = 0; i < count; i++) {
+			const m4f& m = ms[i];
+
+			const f32x4 c0 = load(m.m[0]);
+			const f32x4 c1 = load(m.m[1]);
+			const f32x4 c2 = load(m.m[2]);
+
+			const v3f& mn = aabbs[i].min;
+			const v3f& mx = aabbs[i].max;
+
+			const f32x4 lo = set(mn.x, mn.y, mn.z, 0.0f);
+			const f32x4 hi = set(mx.x, mx.y, mx.z, 0.0f);
+
+			const f32x4 centre = mul(add(lo, hi), half);
+			const f32x4 extent = mul(sub(hi, lo), half);
 
-		return result;
+			f32x4 c = madd(c0, splat<0>(centre), load(m.m[3]));
+			c = madd(c1, splat<1>(centre), c);
+			c = madd(c2, splat<2>(centre), c);
+
+			f32x4 e = mul(simd::abs(c0), splat<0>(extent));
+			e = madd(simd::abs(c1), splat<1>(extent), e);
+			e = madd(simd::abs(c2), splat<2>(extent), e);
+
+			store3(&out[i].min.x, sub(c, e));
+			store3(&out[i].max.x, add(c, e));
+		}
+	}
+
+	void mul_matrices(const m4f* a, const m4f* b, m4f* out, usize count) {
+		for (usize i = 0; i < count; i++) {
+			m4f r;
+			mul_m4f(a[i], b[i], r);
+			out[i] = r;
+		}
 	}
+#endif
 }
@@ -0,0 +1,135 @@
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include "profiler.hpp"
+#include "vkr.hpp"
+
+namespace vkr {
+	namespace profiler {
+		struct Event {
+			const char* name;
+			u64 begin, end;
+		};
+
+		/* Only the owning thread writes to a buffer. head counts every event
+		 * ever written, so a reader can tell which of the ones it copied
+		 * might have been overwritten while it was copying them. */
+		struct ThreadBuffer {
+			Event events[ring_size];
+			std::atomic<u64> head;
+			usize id;
+		};
+
+		/* Buffers are never freed, so that the events of threads that have
+		 * exited still make it into the trace. Each thread gets one of its
+		 * own, and so a row of its own in the trace; the worker pools keep
+		 * their threads, so there are only ever a handful. */
+		static std::mutex buffers_mutex;
+		static std::vector<ThreadBuffer*> buffers;
+
+		static thread_local ThreadBuffer* thread_buffer = null;
+
+		static ThreadBuffer* get_thread_buffer() {
+			if (thread_buffer) { return thread_buffer; }
+
+			std::lock_guard<std::mutex> lock(buffers_mutex);
+
+			thread_buffer = new ThreadBuffer();
+			thread_buffer->head = 0;
+			thread_buffer->id = buffers.size();
+			buffers.push_back(thread_buffer);
+
+			return thread_buffer;
+		}
+
+		u64 now() {
+			return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		void record(const char* name, u64 begin, u64 end) {
+			auto buffer = get_thread_buffer();
+
+			u64 head = buffer->head.load(std::memory_order_relaxed);
+			buffer->events[head % ring_size] = Event { name, begin, end };
+			buffer->head.store(head + 1, std::memory_order_release);
+		}
+
+		static void write_json_string(FILE* file, const char* str) {
+			fputc('"', file);
+
+			for (const char* c = str; *c; c++) {
+				if (*c == '"' || *c == '\\') {
+					fputc('\\', file);
+				}
+
+				fputc(*c, file);
+			}
+
+			fputc('"', file);
+		}
+
+		bool write_trace(const char* path) {
+			FILE* file = fopen(path, "w");
+			if (!file) {
+				error("Failed to open `%s' for writing.", path);
+				return false;
+			}
+
+			std::vector<ThreadBuffer*> to_write;
+			{
+				std::lock_guard<std::mutex> lock(buffers_mutex);
+				to_write = buffers;
+			}
+
+			fprintf(file, "{\"traceEvents\":[");
+
+			std::vector<Event> events;
+			bool first = true;
+			usize written = 0;
+
+			for (auto buffer : to_write) {
+				u64 head = buffer->head.load(std::memory_order_acquire);
+				u64 start = head > ring_size ? head - ring_size : 0;
+
+				events.clear();
+				for (u64 i = start; i < head; i++) {
+					events.push_back(buffer->events[i % ring_size]);
+				}
+
+				/* Anything the owner has lapped since is unreliable, and so is
+				 * the slot it may be writing into right now. */
+				u64 new_head = buffer->head.load(std::memory_order_acquire);
+				usize skip = new_head + 1 > start + ring_size ? (usize)(new_head + 1 - start - ring_size) : 0;
+
+				fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%llu,\"args\":{\"name\":\"Thread %llu\"}}",
+					first ? "" : ",", (unsigned long long)buffer->id, (unsigned long long)buffer->id);
+				first = false;
+
+				for (usize i = skip; i < events.size(); i++) {
+					const auto& event = events[i];
+
+					fprintf(file, ",{\"name\":");
+					write_json_string(file, event.name);
+					fprintf(file, ",\"ph\":\"X\",\"pid\":0,\"tid\":%llu,\"ts\":%.3f,\"dur\":%.3f}",
+						(unsigned long long)buffer->id,
+						(f64)event.begin / 1000.0,
+						(f64)(event.end - event.begin) / 1000.0);
+
+					written++;
+				}
+			}
+
+			fprintf(file, "]}\n");
+			fclose(file);
+
+			info("Wrote %llu profiler events to `%s'.", (unsigned long long)written, path);
+
+			return true;
+		}
+	}
+}
@@ -1,10 +1,14 @@
+#include <stdio.h>
 #include <string.h> /* memcpy */
 #include <math.h>
 
+#include <algorithm>
+
 #include <stb_image.h>
 #include <stb_truetype.h>
 #include <stb_rect_pack.h>
 
+#include "profiler.hpp"
 #include "renderer.hpp"
 #include "vkr.hpp"
 
@@ -20,11 +24,17 @@ namespace vkr {
 			bool use_default_fb,
 			void* uniform_buffer,
 			usize uniform_buffer_size,
-			void* pc, usize pc_size) : framebuffer(null), use_default_fb(use_default_fb),
+			void* pc, usize pc_size,
+			StorageBuffer* storage_buffers, usize storage_buffer_count, f32 scale,
+			Framebuffer* target) : framebuffer(null), use_default_fb(use_default_fb), owns_fb(false),
 			dependency_count(dependency_count), renderer(renderer),
 			pc(pc), pc_size(pc_size) {
 
-		if (!use_default_fb) {
+		if (!use_default_fb && target != null) {
+			framebuffer = target;
+		} else if (!use_default_fb) {
+			owns_fb = true;
+
 			Framebuffer::Attachment attachments[] = {
 				{
 					.type = Framebuffer::Attachment::Type::color,
@@ -34,7 +44,7 @@ namespace vkr {
 
 			framebuffer = new Framebuffer(renderer->app->video,
 				Framebuffer::Flags::headless | Framebuffer::Flags::fit,
-				renderer->app->get_size(), attachments, 1);
+				renderer->app->get_size(), attachments, 1, scale);
 		} else {
 			framebuffer = renderer->app->get_default_framebuffer();
 		}
@@ -56,7 +66,7 @@ namespace vkr {
 		};
 
 
-		Pipeline::Descriptor uniform_descs[2];
+		auto uniform_descs = new Pipeline::Descriptor[2 + storage_buffer_count]();
 		uniform_descs[0].name = "fragment_uniform_buffer";
 		uniform_descs[0].binding = 0;
 		uniform_descs[0].stage = Pipeline::Stage::fragment;
@@ -71,6 +81,18 @@ namespace vkr {
 		uniform_descs[1].resource.uniform.ptr = uniform_buffer;
 		uniform_descs[1].resource.uniform.size = uniform_buffer_size;
 
+		for (usize i = 0; i < storage_buffer_count; i++) {
+			auto desc = uniform_descs + 2 + i;
+
+			desc->name = storage_buffers[i].name;
+			desc->binding = static_cast<u32>(2 + i);
+			desc->stage = Pipeline::Stage::fragment;
+			desc->resource.type = Pipeline::ResourcePointer::Type::storage_buffer;
+			desc->resource.storage.ptr = storage_buffers[i].ptr;
+			desc->resource.storage.size = storage_buffers[i].size;
+			desc->resource.storage.used_size = storage_buffers[i].used_size;
+		}
+
 		auto sampler_descs = new Pipeline::Descriptor[dependency_count]();
 		for (usize i = 0; i < dependency_count; i++) {
 			sampler_descs[i].name = "input";
@@ -78,7 +100,7 @@ namespace vkr {
 			sampler_descs[i].stage = Pipeline::Stage::fragment;
 			sampler_descs[i].resource.type = Pipeline::ResourcePointer::Type::framebuffer_output;
 			sampler_descs[i].resource.framebuffer.ptr = dependencies[i].framebuffer;
-			sampler_descs[i].resource.framebuffer.sampler = renderer->fb_sampler;
+			sampler_descs[i].resource.framebuffer.sampler = dependencies[i].sampler != null ? dependencies[i].sampler : renderer->fb_sampler;
 			sampler_descs[i].resource.framebuffer.attachment = dependencies[i].attachment;
 		}
 
@@ -86,7 +108,7 @@ namespace vkr {
 			{
 				.name = "uniforms",
 				.descriptors = uniform_descs,
-				.count = (uniform_buffer_size > 0) ? 2u : 1u,
+				.count = (uniform_buffer_size > 0) ? 2 + storage_buffer_count : 1,
 			},
 			{
 				.name = "samplers",
@@ -114,11 +136,12 @@ namespace vkr {
 			pc_range, pc_size > 0 ? 1 : 0);
 
 		delete[] sampler_descs;
+		delete[] uniform_descs;
 	}
 
 	PostProcessStep::~PostProcessStep() {
 		delete pipeline;
-		if (!use_default_fb) {
+		if (owns_fb) {
 			delete framebuffer;
 		}
 	}
@@ -146,19 +169,461 @@ namespace vkr {
 		}
 	}
 
-	Renderer3D::Renderer3D(App* app, VideoContext* video, const ShaderConfig& shaders, Material* materials, usize material_count) :
-		app(app), model(null) {
+	RenderGraph::RenderGraph(Renderer3D* renderer) : renderer(renderer), fused_passes(0), default_fb_start(0), compiled(false) {}
+
+	RenderGraph::~RenderGraph() {
+		for (auto& node : nodes) {
+			delete node.step;
+		}
+
+		for (auto fb : framebuffers) {
+			delete fb;
+		}
+	}
+
+	RenderGraph::Image* RenderGraph::find_image(const std::string& name) {
+		for (auto& image : images) {
+			if (image.name == name) {
+				return &image;
+			}
+		}
+
+		return null;
+	}
+
+	void RenderGraph::add_external(const char* name, Framebuffer* framebuffer, u32 attachment) {
+		if (compiled) {
+			abort_with("Cannot add to a render graph after it has been compiled.");
+		}
+
+		if (find_image(name)) {
+			abort_with("Render graph image `%s' declared more than once.", name);
+		}
+
+		images.push_back(Image {
+			.name = name,
+			.framebuffer = framebuffer,
+			.attachment = attachment,
+			.external = true,
+			.scale = 1.0f,
+			.first = 0,
+			.last = 0
+		});
+	}
+
+	void RenderGraph::add_pass(const Pass& pass) {
+		if (compiled) {
+			abort_with("Cannot add to a render graph after it has been compiled.");
+		}
+
+		Node node;
+		node.name = pass.name;
+		node.shader = pass.shader;
+		node.output = pass.output != null ? pass.output : "";
+		node.scale = pass.scale;
+		node.per_pixel = pass.per_pixel;
+		node.uniform_buffer = pass.uniform_buffer;
+		node.uniform_buffer_size = pass.uniform_buffer_size;
+		node.pc = pass.pc;
+		node.pc_size = pass.pc_size;
+		node.step = null;
+
+		for (usize i = 0; i < pass.input_count; i++) {
+			node.inputs.push_back(pass.inputs[i].name);
+			node.samplers.push_back(pass.inputs[i].sampler);
+		}
+
+		node.storage_buffers.assign(pass.storage_buffers, pass.storage_buffers + pass.storage_buffer_count);
+
+		nodes.push_back(node);
+	}
+
+	void RenderGraph::add_fusion(const char* first, const char* second, Shader* shader) {
+		if (compiled) {
+			abort_with("Cannot add to a render graph after it has been compiled.");
+		}
+
+		fusions.push_back(Fusion { first, second, shader });
+	}
+
+	/* Replaces each pair of passes given to add_fusion with one pass, so that
+	 * the image between them is never written out. */
+	void RenderGraph::fuse() {
+		for (const auto& fusion : fusions) {
+			usize first_idx = (usize)-1, second_idx = (usize)-1;
+			for (usize i = 0; i < nodes.size(); i++) {
+				if (nodes[i].name == fusion.first)  { first_idx = i; }
+				if (nodes[i].name == fusion.second) { second_idx = i; }
+			}
+
+			if (first_idx == (usize)-1 || second_idx == (usize)-1) { continue; }
+
+			auto& first = nodes[first_idx];
+			auto& second = nodes[second_idx];
+
+			usize reads = 0;
+			bool read_by_second = false;
+			for (const auto& node : nodes) {
+				for (const auto& input : node.inputs) {
+					if (!first.output.empty() && input == first.output) {
+						reads++;
+						read_by_second = read_by_second || &node == &second;
+					}
+				}
+			}
+
+			const char* reason = null;
+			if (!first.per_pixel || !second.per_pixel) {
+				reason = "both passes must be per-pixel";
+			} else if (!read_by_second) {
+				reason = "the second pass doesn't read the first";
+			} else if (reads > 1) {
+				reason = "something else reads the image between them";
+			} else if (first.scale != second.scale) {
+				reason = "the passes are different sizes";
+			} else if (first.uniform_buffer || first.pc || !first.storage_buffers.empty()) {
+				reason = "the first pass has buffers of its own";
+			}
+
+			if (reason) {
+				warning("Not fusing render graph passes `%s' and `%s': %s.",
+					fusion.first.c_str(), fusion.second.c_str(), reason);
+				continue;
+			}
+
+			std::vector<std::string> inputs;
+			std::vector<Sampler*> samplers;
+			for (usize i = 0; i < second.inputs.size(); i++) {
+				if (second.inputs[i] == first.output) {
+					inputs.insert(inputs.end(), first.inputs.begin(), first.inputs.end());
+					samplers.insert(samplers.end(), first.samplers.begin(), first.samplers.end());
+				} else {
+					inputs.push_back(second.inputs[i]);
+					samplers.push_back(second.samplers[i]);
+				}
+			}
+
+			second.name = first.name + "+" + second.name;
+			second.shader = fusion.shader;
+			second.inputs = inputs;
+			second.samplers = samplers;
+
+			nodes.erase(nodes.begin() + first_idx);
+			fused_passes++;
+		}
+	}
+
+	void RenderGraph::compile() {
+		if (compiled) {
+			abort_with("Render graph compiled more than once.");
+		}
+
+		fuse();
+
+		/* Each image written by a pass is produced by that pass only. */
+		std::vector<usize> producers(images.size(), (usize)-1);
+		for (usize i = 0; i < nodes.size(); i++) {
+			auto& node = nodes[i];
+
+			if (node.output.empty()) { continue; }
+
+			if (find_image(node.output)) {
+				abort_with("Render graph image `%s' is written by more than one pass.", node.output.c_str());
+			}
+
+			images.push_back(Image {
+				.name = node.output,
+				.framebuffer = null,
+				.attachment = 0,
+				.external = false,
+				.scale = node.scale,
+				.first = 0,
+				.last = 0
+			});
+
+			producers.push_back(i);
+		}
+
+		/* Order the passes so that every image is written before it is read.
+		 * Ties go to the pass that was added first, and passes drawing to
+		 * the default framebuffer are held back until nothing else is left. */
+		std::vector<usize> waiting(nodes.size(), 0);
+		std::vector<std::vector<usize>> readers(images.size());
+		for (usize i = 0; i < nodes.size(); i++) {
+			for (const auto& input : nodes[i].inputs) {
+				auto image = find_image(input);
+				if (!image) {
+					abort_with("Render graph pass `%s' reads `%s', which nothing writes.",
+						nodes[i].name.c_str(), input.c_str());
+				}
+
+				usize image_idx = (usize)(image - images.data());
+				readers[image_idx].push_back(i);
+
+				if (!image->external) {
+					waiting[i]++;
+				}
+			}
+		}
+
+		std::vector<bool> done(nodes.size(), false);
+		std::vector<usize> position(nodes.size());
+		order.clear();
+
+		while (order.size() < nodes.size()) {
+			usize next = (usize)-1;
+			for (usize i = 0; i < nodes.size(); i++) {
+				if (done[i] || waiting[i] > 0) { continue; }
+
+				if (next == (usize)-1 || (nodes[next].output.empty() && !nodes[i].output.empty())) {
+					next = i;
+				}
+
+				if (!nodes[next].output.empty()) { break; }
+			}
+
+			if (next == (usize)-1) {
+				abort_with("Render graph has a cycle.");
+			}
+
+			done[next] = true;
+			position[next] = order.size();
+			order.push_back(next);
+
+			if (nodes[next].output.empty()) { continue; }
+
+			usize image_idx = (usize)(find_image(nodes[next].output) - images.data());
+			for (auto reader : readers[image_idx]) {
+				waiting[reader]--;
+			}
+		}
+
+		default_fb_start = order.size();
+		for (usize i = 0; i < order.size(); i++) {
+			if (nodes[order[i]].output.empty()) {
+				default_fb_start = i;
+				break;
+			}
+		}
+
+		/* Lifetimes, from the pass that writes an image to the last pass
+		 * that reads it. */
+		for (usize i = 0; i < images.size(); i++) {
+			auto& image = images[i];
+			if (image.external) { continue; }
+
+			image.first = position[producers[i]];
+			image.last = image.first;
+			for (auto reader : readers[i]) {
+				image.last = std::max(image.last, position[reader]);
+			}
+		}
+
+		/* Give images framebuffers in the order they are first written,
+		 * reusing any framebuffer of the same size whose last image has
+		 * been read for the last time by then. */
+		std::vector<usize> by_first;
+		for (usize i = 0; i < images.size(); i++) {
+			if (!images[i].external) {
+				by_first.push_back(i);
+			}
+		}
+
+		std::sort(by_first.begin(), by_first.end(), [&](usize a, usize b) {
+			return images[a].first < images[b].first;
+		});
+
+		struct Slot {
+			Framebuffer* framebuffer;
+			f32 scale;
+			usize last;
+		};
+
+		std::vector<Slot> slots;
+
+		Framebuffer::Attachment attachments[] = {
+			{
+				.type = Framebuffer::Attachment::Type::color,
+				.format = Framebuffer::Attachment::Format::rgbaf16,
+			}
+		};
+
+		for (auto i : by_first) {
+			auto& image = images[i];
+
+			Slot* slot = null;
+			for (auto& s : slots) {
+				if (s.scale == image.scale && s.last < image.first) {
+					slot = &s;
+					break;
+				}
+			}
+
+			if (!slot) {
+				auto fb = new Framebuffer(renderer->app->video,
+					Framebuffer::Flags::headless | Framebuffer::Flags::fit,
+					renderer->app->get_size(), attachments, 1, image.scale);
+
+				framebuffers.push_back(fb);
+				slots.push_back(Slot { fb, image.scale, 0 });
+				slot = &slots.back();
+			}
+
+			slot->last = image.last;
+			image.framebuffer = slot->framebuffer;
+		}
+
+		/* Create the steps, now that their framebuffers are known. */
+		for (auto i : order) {
+			auto& node = nodes[i];
+
+			std::vector<PostProcessStep::Dependency> deps(node.inputs.size());
+			for (usize ii = 0; ii < node.inputs.size(); ii++) {
+				auto image = find_image(node.inputs[ii]);
+
+				deps[ii].name = node.inputs[ii].c_str();
+				deps[ii].framebuffer = image->framebuffer;
+				deps[ii].attachment = image->attachment;
+				deps[ii].sampler = node.samplers[ii];
+			}
+
+			bool to_default_fb = node.output.empty();
+
+			node.step = new PostProcessStep(renderer, node.shader, deps.data(), deps.size(), to_default_fb,
+				node.uniform_buffer, node.uniform_buffer_size, node.pc, node.pc_size,
+				node.storage_buffers.data(), node.storage_buffers.size(), node.scale,
+				to_default_fb ? null : find_image(node.output)->framebuffer);
+		}
+
+		compiled = true;
+	}
+
+	void RenderGraph::execute() {
+		auto video = renderer->app->video;
+
+		for (usize i = 0; i < default_fb_start; i++) {
+			auto& node = nodes[order[i]];
+
+			video->begin_gpu_timer(node.name.c_str());
+			node.step->execute();
+			video->end_gpu_timer();
+		}
+	}
+
+	void RenderGraph::execute_to_default_framebuffer() {
+		auto video = renderer->app->video;
+
+		for (usize i = default_fb_start; i < order.size(); i++) {
+			auto& node = nodes[order[i]];
+
+			video->begin_gpu_timer(node.name.c_str());
+			node.step->execute();
+			video->end_gpu_timer();
+		}
+	}
+
+	Framebuffer* RenderGraph::get_framebuffer(const char* name) {
+		auto image = find_image(name);
+		return image ? image->framebuffer : null;
+	}
+
+	/* Every image in the graph is rgbaf16. */
+	static constexpr usize rgbaf16_pixel_size = 8;
+
+	RenderGraph::MemoryReport RenderGraph::get_memory_report() const {
+		MemoryReport r = {};
+		r.fused_passes = fused_passes;
+
+		const usize frames = renderer->app->video->get_frames_in_flight();
+		const v2i size = renderer->app->get_size();
+
+		for (const auto& image : images) {
+			if (image.external) { continue; }
+
+			r.image_count++;
+
+			usize w = (usize)std::max((i32)((f32)size.x * image.scale), 1);
+			usize h = (usize)std::max((i32)((f32)size.y * image.scale), 1);
+			r.unaliased_bytes += w * h * rgbaf16_pixel_size * frames;
+		}
+
+		for (auto fb : framebuffers) {
+			auto fb_size = fb->get_scaled_size();
+
+			r.framebuffer_count++;
+			r.bytes += (usize)fb_size.x * (usize)fb_size.y * rgbaf16_pixel_size * frames;
+		}
+
+		return r;
+	}
+
+	void RenderGraph::print_memory_report() const {
+		auto r = get_memory_report();
+
+		info("Render graph: %llu images in %llu framebuffers, %.2f MiB (%.2f MiB without aliasing); %llu passes fused.",
+			(unsigned long long)r.image_count, (unsigned long long)r.framebuffer_count,
+			(f64)r.bytes / (1024.0 * 1024.0), (f64)r.unaliased_bytes / (1024.0 * 1024.0),
+			(unsigned long long)r.fused_passes);
+	}
+
+	static const char* shadow_cascade_timer_names[shadow_cascade_count] = {
+		"shadow cascade 0",
+		"shadow cascade 1",
+		"shadow cascade 2",
+		"shadow cascade 3"
+	};
+
+	struct Renderer3D::Snapshot {
+		std::vector<m4f> transforms;
+		std::vector<AABB> aabbs; /* World space. */
+		std::vector<Model3D*> models;
+		std::vector<usize> materials;
+		std::vector<u64> keys;   /* Hash of the transform and model, to spot moved casters. */
+
+		AABB scene_aabb;
+
+		struct Light {
+			PointLight light;
+			v3f position;
+		};
+
+		std::vector<Light> lights;
+
+		Camera camera;
+	};
+
+	Renderer3D::Renderer3D(App* app, VideoContext* video, const ShaderConfig& shaders, Material* materials, usize material_count,
+		GBufferLayout gbuffer_layout) :
+		app(app), gbuffer_layout(gbuffer_layout), model(null) {
+
+		stats = {};
 
 		pp_config.bloom_threshold = 2.0f;
-		pp_config.bloom_blur_intensity = 350.0f;
+		pp_config.bloom_blur_intensity = 1.0f;
 		pp_config.bloom_intensity = 0.2f;
 		sun.bias = 0.0f;
 		sun.softness = 0.15f;
+		sun.quality = ShadowQuality::pcss_high;
 		sun.pcf_sample_count = 64;
 		sun.blocker_search_sample_count = 36;
+		sun.shadow_distance = 100.0f;
+		sun.cascade_split_lambda = 0.75f;
+
+		workers = new WorkerPool();
+		record_thread_count = workers->get_thread_count();
+
+		snapshots = new Snapshot[2]();
+		front_snapshot = 0;
+
+		point_lights = new impl_PointLight[max_point_lights]();
+		clusters = new impl_Cluster[cluster_count]();
+		cluster_light_indices = new u32[max_cluster_light_indices]();
+		point_lights_used_size = 0;
+		cluster_light_indices_used_size = 0;
 
 		shadow_sampler = new Sampler(video, Sampler::Flags::filter_linear | Sampler::Flags::shadow);
 		fb_sampler     = new Sampler(video, Sampler::Flags::filter_none | Sampler::Flags::clamp);
+		bloom_sampler  = new Sampler(video, Sampler::Flags::filter_linear | Sampler::Flags::clamp);
 
 		default_texture = new Texture(video, (const void*)default_texture_data, v2i(2, 2),
 			Texture::Flags::dimentions_2 | Texture::Flags::filter_none | Texture::Flags::format_rgba8);
@@ -187,13 +652,33 @@ namespace vkr {
 			.format = Framebuffer::Attachment::Format::depth
 		};
 
-		scene_fb = new Framebuffer(video,
-			Framebuffer::Flags::headless | Framebuffer::Flags::fit,
-			app->get_size(), attachments, 4);
+		/* 8 bytes a pixel besides depth, rather than 24. */
+		Framebuffer::Attachment compact_attachments[] = {
+			{
+				.type = Framebuffer::Attachment::Type::color,
+				.format = Framebuffer::Attachment::Format::r11g11b10f,
+			},
+			{
+				.type = Framebuffer::Attachment::Type::color,
+				.format = Framebuffer::Attachment::Format::rgf16,
+			},
+			{
+				.type = Framebuffer::Attachment::Type::depth,
+				.format = Framebuffer::Attachment::Format::depth,
+			},
+		};
+
+		if (gbuffer_layout == GBufferLayout::compact) {
+			scene_fb = new Framebuffer(video,
+				Framebuffer::Flags::headless | Framebuffer::Flags::fit,
+				app->get_size(), compact_attachments, 3);
+		} else {
+			scene_fb = new Framebuffer(video,
+				Framebuffer::Flags::headless | Framebuffer::Flags::fit,
+				app->get_size(), attachments, 4);
+		}
 
-		shadow_fb = new Framebuffer(video,
-			Framebuffer::Flags::headless,
-			v2i(2048, 2048), &shadow_attachment, 1);
+		scene_fb->set_gpu_timer_name("gbuffer");
 
 		Pipeline::Attribute attribs[] = {
 			{
@@ -246,7 +731,7 @@ namespace vkr {
 		this->materials = new Material[material_count]();
 		memcpy(this->materials, materials, material_count * sizeof(Material));
 
-		Pipeline::Descriptor uniform_descs[4];
+		Pipeline::Descriptor uniform_descs[2 + shadow_cascade_count * 2];
 		uniform_descs[0].name = "vertex_uniform_buffer";
 		uniform_descs[0].binding = 0;
 		uniform_descs[0].stage = Pipeline::Stage::vertex;
@@ -261,26 +746,49 @@ namespace vkr {
 		uniform_descs[1].resource.uniform.ptr  = &f_ub;
 		uniform_descs[1].resource.uniform.size = sizeof(f_ub);
 
-		uniform_descs[2].name = "blockermap";
-		uniform_descs[2].binding = 2;
-		uniform_descs[2].stage = Pipeline::Stage::fragment;
-		uniform_descs[2].resource.type = Pipeline::ResourcePointer::Type::framebuffer_output;
-		uniform_descs[2].resource.framebuffer.ptr = shadow_fb;
-		uniform_descs[2].resource.framebuffer.sampler = fb_sampler;
-		uniform_descs[2].resource.framebuffer.attachment = 0;
-
-		uniform_descs[3].name = "shadowmap";
-		uniform_descs[3].binding = 3;
-		uniform_descs[3].stage = Pipeline::Stage::fragment;
-		uniform_descs[3].resource.type = Pipeline::ResourcePointer::Type::framebuffer_output;
-		uniform_descs[3].resource.framebuffer.ptr = shadow_fb;
-		uniform_descs[3].resource.framebuffer.sampler = shadow_sampler;
-		uniform_descs[3].resource.framebuffer.attachment = 0;
+		/* Each cascade's shadow map is bound twice: once as a plain depth
+		 * texture for the blocker search and once with a comparison
+		 * sampler for the filtering. */
+		for (usize i = 0; i < shadow_cascade_count; i++) {
+			auto cascade = cascades + i;
+
+			cascade->fb = new Framebuffer(video,
+				Framebuffer::Flags::headless,
+				v2i(shadow_cascade_res, shadow_cascade_res), &shadow_attachment, 1);
+			cascade->fb->set_gpu_timer_name(shadow_cascade_timer_names[i]);
+
+			/* Nothing can match these, so the first frame always renders. */
+			cascade->matrix = m4f(0.0f);
+			cascade->caster_count = (usize)-1;
+			cascade->caster_keys = 0;
+			cascade->version = 1;
+			cascade->rendered_versions.resize(video->get_frames_in_flight(), 0);
+			cascade->stale = false;
+			cascade->list = new CommandList(video);
+
+			auto blocker_desc = uniform_descs + 2 + i;
+			blocker_desc->name = "blockermap";
+			blocker_desc->binding = static_cast<u32>(2 + i);
+			blocker_desc->stage = Pipeline::Stage::fragment;
+			blocker_desc->resource.type = Pipeline::ResourcePointer::Type::framebuffer_output;
+			blocker_desc->resource.framebuffer.ptr = cascade->fb;
+			blocker_desc->resource.framebuffer.sampler = fb_sampler;
+			blocker_desc->resource.framebuffer.attachment = 0;
+
+			auto shadow_desc = uniform_descs + 2 + shadow_cascade_count + i;
+			shadow_desc->name = "shadowmap";
+			shadow_desc->binding = static_cast<u32>(2 + shadow_cascade_count + i);
+			shadow_desc->stage = Pipeline::Stage::fragment;
+			shadow_desc->resource.type = Pipeline::ResourcePointer::Type::framebuffer_output;
+			shadow_desc->resource.framebuffer.ptr = cascade->fb;
+			shadow_desc->resource.framebuffer.sampler = shadow_sampler;
+			shadow_desc->resource.framebuffer.attachment = 0;
+		}
 
 		auto desc_sets = new Pipeline::DescriptorSet[1 + material_count]();
 		desc_sets[0].name = "uniforms";
 		desc_sets[0].descriptors = uniform_descs;
-		desc_sets[0].count = 4;
+		desc_sets[0].count = 2 + shadow_cascade_count * 2;
 
 		for (usize i = 0; i < material_count; i++) {
 			auto set = desc_sets + i + 1;
@@ -313,30 +821,34 @@ namespace vkr {
 			desc_sets, material_count + 1,
 			pc, 2);
 
-		Pipeline::Descriptor shadow_uniform_descs[1];
-		shadow_uniform_descs[0].name = "vertex_uniform_buffer";
-		shadow_uniform_descs[0].binding = 0;
-		shadow_uniform_descs[0].stage = Pipeline::Stage::vertex;
-		shadow_uniform_descs[0].resource.type = Pipeline::ResourcePointer::Type::uniform_buffer;
-		shadow_uniform_descs[0].resource.uniform.ptr  = &shadow_v_ub;
-		shadow_uniform_descs[0].resource.uniform.size = sizeof(shadow_v_ub);
+		for (usize i = 0; i < shadow_cascade_count; i++) {
+			auto cascade = cascades + i;
 
-		Pipeline::DescriptorSet shadow_desc_set = {
-			.name = "uniforms",
-			.descriptors = shadow_uniform_descs,
-			.count = 1
-		};
+			Pipeline::Descriptor shadow_uniform_descs[1];
+			shadow_uniform_descs[0].name = "vertex_uniform_buffer";
+			shadow_uniform_descs[0].binding = 0;
+			shadow_uniform_descs[0].stage = Pipeline::Stage::vertex;
+			shadow_uniform_descs[0].resource.type = Pipeline::ResourcePointer::Type::uniform_buffer;
+			shadow_uniform_descs[0].resource.uniform.ptr  = &cascade->v_ub;
+			shadow_uniform_descs[0].resource.uniform.size = sizeof(cascade->v_ub);
 
-		shadow_pip = new Pipeline(video,
-			Pipeline::Flags::depth_test |
-			Pipeline::Flags::cull_front_face |
-			Pipeline::Flags::front_face_clockwise,
-			shaders.shadowmap,
-			sizeof(Vertex),
-			attribs, 1,
-			shadow_fb,
-			&shadow_desc_set, 1,
-			pc, 1);
+			Pipeline::DescriptorSet shadow_desc_set = {
+				.name = "uniforms",
+				.descriptors = shadow_uniform_descs,
+				.count = 1
+			};
+
+			cascade->pip = new Pipeline(video,
+				Pipeline::Flags::depth_test |
+				Pipeline::Flags::cull_front_face |
+				Pipeline::Flags::front_face_clockwise,
+				shaders.shadowmap,
+				sizeof(Vertex),
+				attribs, 1,
+				cascade->fb,
+				&shadow_desc_set, 1,
+				pc, 1);
+		}
 
 		v2f tri_verts[] = {
 			/* Position          UV */
@@ -347,100 +859,156 @@ namespace vkr {
 
 		fullscreen_tri = new VertexBuffer(video, tri_verts, sizeof(tri_verts));
 
-		PostProcessStep::Dependency lighting_deps[] = {
+		post = new RenderGraph(this);
+
+		/* The compact layout has no positions. The lighting pass works them
+		 * out from depth instead, which takes their place. */
+		const char* scene_positions = gbuffer_layout == GBufferLayout::compact ? "scene_depth" : "scene_positions";
+
+		post->add_external("scene_color",   scene_fb, 0);
+		post->add_external("scene_normals", scene_fb, 1);
+		post->add_external(scene_positions, scene_fb, 2);
+
+		PostProcessStep::StorageBuffer lighting_buffers[] = {
 			{
-				.name = "color",
-				.framebuffer = scene_fb,
-				.attachment = 0
+				.name = "point_lights",
+				.ptr = point_lights,
+				.size = max_point_lights * sizeof(impl_PointLight),
+				.used_size = &point_lights_used_size
 			},
 			{
-				.name = "normals",
-				.framebuffer = scene_fb,
-				.attachment = 1
+				.name = "clusters",
+				.ptr = clusters,
+				.size = cluster_count * sizeof(impl_Cluster)
 			},
 			{
-				.name = "positions",
-				.framebuffer = scene_fb,
-				.attachment = 2
+				.name = "cluster_light_indices",
+				.ptr = cluster_light_indices,
+				.size = max_cluster_light_indices * sizeof(u32),
+				.used_size = &cluster_light_indices_used_size
 			}
 		};
 
-		lighting = new PostProcessStep(this, shaders.lighting, lighting_deps, 3, false, &light_ub, sizeof(light_ub), &f_pc, sizeof(f_pc));
-
-		PostProcessStep::Dependency bright_extract_deps[] = {
-			{
-				.name = "color",
-				.framebuffer = lighting->get_framebuffer(),
-				.attachment = 0
-			}
+		RenderGraph::Input lighting_inputs[] = {
+			{ .name = "scene_color" },
+			{ .name = "scene_normals" },
+			{ .name = scene_positions }
 		};
 
-		bright_extract = new PostProcessStep(this, shaders.bright_extract, bright_extract_deps, 1);
+		post->add_pass(RenderGraph::Pass {
+			.name = "lighting",
+			.shader = shaders.lighting,
+			.inputs = lighting_inputs,
+			.input_count = 3,
+			.output = "lit_scene",
+			.uniform_buffer = &light_ub,
+			.uniform_buffer_size = sizeof(light_ub),
+			.pc = &f_pc,
+			.pc_size = sizeof(f_pc),
+			.storage_buffers = lighting_buffers,
+			.storage_buffer_count = 3
+		});
+
+		RenderGraph::Input tonemap_inputs[] = {
+			{ .name = "lit_scene" }
+		};
 
-		PostProcessStep::Dependency blur_v_deps[] = {
-			{
-				.name = "color",
-				.framebuffer = bright_extract->get_framebuffer(),
-				.attachment = 0
-			}
+		post->add_pass(RenderGraph::Pass {
+			.name = "tonemap",
+			.shader = shaders.tonemap,
+			.inputs = tonemap_inputs,
+			.input_count = 1,
+			.output = "tonemapped_scene",
+			.per_pixel = true
+		});
+
+		/* Bloom. The bright parts of the image are extracted at half size,
+		 * then blurred by repeatedly halving and doubling the size with a
+		 * dual filter, which spreads them wide for a fraction of the cost of
+		 * a blur at full size. Bilinear filtering does part of the work. */
+		RenderGraph::Input bright_extract_inputs[] = {
+			{ .name = "lit_scene", .sampler = bloom_sampler }
 		};
 
-		blur_v = new PostProcessStep(this, shaders.blur_v, blur_v_deps, 1);
+		post->add_pass(RenderGraph::Pass {
+			.name = "bright_extract",
+			.shader = shaders.bright_extract,
+			.inputs = bright_extract_inputs,
+			.input_count = 1,
+			.output = "bloom_down_0",
+			.scale = 0.5f
+		});
 
-		PostProcessStep::Dependency blur_h_deps[] = {
-			{
-				.name = "color",
-				.framebuffer = blur_v->get_framebuffer(),
-				.attachment = 0
-			}
-		};
+		char input_name[32], output_name[32];
 
-		blur_h = new PostProcessStep(this, shaders.blur_h, blur_h_deps, 1);
+		f32 bloom_scale = 0.5f;
+		for (usize i = 0; i < bloom_levels; i++) {
+			snprintf(input_name, sizeof(input_name), "bloom_down_%zu", i);
+			snprintf(output_name, sizeof(output_name), "bloom_down_%zu", i + 1);
 
-		PostProcessStep::Dependency blur_v2_deps[] = {
-			{
-				.name = "color",
-				.framebuffer = blur_h->get_framebuffer(),
-				.attachment = 0
-			}
-		};
+			RenderGraph::Input inputs[] = {
+				{ .name = input_name, .sampler = bloom_sampler }
+			};
 
-		blur_v2 = new PostProcessStep(this, shaders.blur_v, blur_v2_deps, 1);
+			bloom_scale *= 0.5f;
+			post->add_pass(RenderGraph::Pass {
+				.name = output_name,
+				.shader = shaders.bloom_downsample,
+				.inputs = inputs,
+				.input_count = 1,
+				.output = output_name,
+				.scale = bloom_scale
+			});
+		}
 
-		PostProcessStep::Dependency blur_h2_deps[] = {
-			{
-				.name = "color",
-				.framebuffer = blur_v2->get_framebuffer(),
-				.attachment = 0
+		/* Back up to the size of the bright pass. */
+		for (usize i = 0; i < bloom_levels; i++) {
+			if (i == 0) {
+				snprintf(input_name, sizeof(input_name), "bloom_down_%zu", bloom_levels);
+			} else {
+				snprintf(input_name, sizeof(input_name), "bloom_up_%zu", i - 1);
 			}
-		};
 
-		blur_h2 = new PostProcessStep(this, shaders.blur_h, blur_h2_deps, 1);
+			snprintf(output_name, sizeof(output_name), "bloom_up_%zu", i);
 
-		PostProcessStep::Dependency tonemap_deps[] = {
-			{
-				.name = "color",
-				.framebuffer = lighting->get_framebuffer(),
-				.attachment = 0
-			}
-		};
+			RenderGraph::Input inputs[] = {
+				{ .name = input_name, .sampler = bloom_sampler }
+			};
+
+			bloom_scale *= 2.0f;
+			post->add_pass(RenderGraph::Pass {
+				.name = output_name,
+				.shader = shaders.bloom_upsample,
+				.inputs = inputs,
+				.input_count = 1,
+				.output = output_name,
+				.scale = bloom_scale
+			});
+		}
 
-		tonemap = new PostProcessStep(this, shaders.tonemap, tonemap_deps, 1);
+		snprintf(input_name, sizeof(input_name), "bloom_up_%zu", bloom_levels - 1);
 
-		PostProcessStep::Dependency composite_deps[] = {
-			{
-				.name = "tonemapped_scene",
-				.framebuffer = tonemap->get_framebuffer(),
-				.attachment = 0
-			},
-			{
-				.name = "bloom",
-				.framebuffer = blur_h2->get_framebuffer(),
-				.attachment = 0
-			}
+		RenderGraph::Input composite_inputs[] = {
+			{ .name = "tonemapped_scene" },
+			{ .name = input_name, .sampler = bloom_sampler }
 		};
 
-		composite = new PostProcessStep(this, shaders.composite, composite_deps, 2, true);
+		post->add_pass(RenderGraph::Pass {
+			.name = "composite",
+			.shader = shaders.composite,
+			.inputs = composite_inputs,
+			.input_count = 2,
+			.output = null,
+			.per_pixel = true
+		});
+
+		/* Saves writing out and reading back a full size image. */
+		if (shaders.tonemap_composite) {
+			post->add_fusion("tonemap", "composite", shaders.tonemap_composite);
+		}
+
+		post->compile();
+		post->print_memory_report();
 
 		for (usize i = 0; i < material_count; i++) {
 			delete[] desc_sets[i + 1].descriptors;
@@ -452,98 +1020,116 @@ namespace vkr {
 	Renderer3D::~Renderer3D() {
 		delete shadow_sampler;
 		delete fb_sampler;
+		delete bloom_sampler;
 
 		delete fullscreen_tri;
 		delete scene_fb;
-		delete shadow_pip;
-		delete shadow_fb;
-		delete tonemap;
-		delete lighting;
-		delete composite;
-		delete bright_extract;
-		delete blur_v;
-		delete blur_h;
-		delete blur_v2;
-		delete blur_h2;
+
+		for (usize i = 0; i < shadow_cascade_count; i++) {
+			delete cascades[i].list;
+			delete cascades[i].pip;
+			delete cascades[i].fb;
+		}
+
+		for (auto list : scene_lists) {
+			delete list;
+		}
+
+		delete workers;
+
+		delete post;
 		delete scene_pip;
 
 		delete[] materials;
 
+		delete[] point_lights;
+		delete[] clusters;
+		delete[] cluster_light_indices;
+
+		delete[] snapshots;
+
 		delete default_texture;
 	}
 
-	void Renderer3D::draw(ecs::World* world, ecs::Entity camera_ent) {
-		auto size = app->get_size();
+	void Renderer3D::snapshot(ecs::World* world, ecs::Entity camera_ent) {
+		profile_function();
 
-		AABB scene_aabb = {
-			.min = { INFINITY, INFINITY, INFINITY },
-			.max = { -INFINITY, -INFINITY, -INFINITY }
-		};
-
-		for (auto view = world->new_view<Transform, Renderable3D>(); view.valid(); view.next()) {
-			auto& trans = view.get<Transform>();
-			auto& renderable = view.get<Renderable3D>();
+		auto& snap = snapshots[front_snapshot ^ 1];
 
-			const auto& model_aabb = m4f::transform(trans.m, renderable.model->get_aabb());
+		snap.transforms.clear();
+		snap.aabbs.clear();
+		snap.models.clear();
+		snap.materials.clear();
+		snap.keys.clear();
+		snap.lights.clear();
 
-			scene_aabb.min.x = std::min(scene_aabb.min.x, model_aabb.min.x);
-			scene_aabb.min.y = std::min(scene_aabb.min.y, model_aabb.min.y);
-			scene_aabb.min.z = std::min(scene_aabb.min.z, model_aabb.min.z);
-			scene_aabb.max.x = std::max(scene_aabb.max.x, model_aabb.max.x);
-			scene_aabb.max.y = std::max(scene_aabb.max.y, model_aabb.max.y);
-			scene_aabb.max.z = std::max(scene_aabb.max.z, model_aabb.max.z);
-		}
+		{
+			profile_scope("Renderable view");
 
-		shadow_v_ub.view = m4f::lookat(
-			sun.direction,
-			v3f(0.0f, 0.0f, 0.0f),
-			v3f(0.0f, 1.0f, 0.0f));
+			for (auto view = world->new_view<Transform, Renderable3D>(); view.valid(); view.next()) {
+				auto& trans = view.get<Transform>();
+				auto& renderable = view.get<Renderable3D>();
 
-		scene_aabb = m4f::transform(shadow_v_ub.view, scene_aabb);
+				snap.transforms.push_back(trans.m);
+				snap.aabbs.push_back(renderable.model->get_aabb());
+				snap.models.push_back(renderable.model);
+				snap.materials.push_back(renderable.material_id);
 
-		float z_mul = 3.0f;
-		if (scene_aabb.min.z < 0.0f) {
-			scene_aabb.min.z *= z_mul;
-		} else {
-			scene_aabb.min.z /= z_mul;
+				/* Transforms aren't always marked as changed when they are
+				 * written, so the contents are compared instead. */
+				struct { m4f m; Model3D* model; } key = { trans.m, renderable.model };
+				snap.keys.push_back(elf_hash((const u8*)&key, sizeof(key)));
+			}
 		}
 
-		if (scene_aabb.max.z < 0.0f) {
-			scene_aabb.max.z /= z_mul;
-		} else {
-			scene_aabb.max.z *= z_mul;
-		}
+		/* World space bounds of every renderable, in view order. */
+		transform_aabbs(snap.transforms.data(), snap.aabbs.data(), snap.aabbs.data(), snap.aabbs.size());
 
-		shadow_v_ub.projection = m4f::orth(
-			scene_aabb.min.x, scene_aabb.max.x,
-			scene_aabb.min.y, scene_aabb.max.y,
-			scene_aabb.min.z, scene_aabb.max.z);
+		snap.scene_aabb = {
+			.min = { INFINITY, INFINITY, INFINITY },
+			.max = { -INFINITY, -INFINITY, -INFINITY }
+		};
 
-		v_ub.sun_matrix = shadow_v_ub.projection * shadow_v_ub.view;
+		for (const auto& model_aabb : snap.aabbs) {
+			snap.scene_aabb.min.x = std::min(snap.scene_aabb.min.x, model_aabb.min.x);
+			snap.scene_aabb.min.y = std::min(snap.scene_aabb.min.y, model_aabb.min.y);
+			snap.scene_aabb.min.z = std::min(snap.scene_aabb.min.z, model_aabb.min.z);
+			snap.scene_aabb.max.x = std::max(snap.scene_aabb.max.x, model_aabb.max.x);
+			snap.scene_aabb.max.y = std::max(snap.scene_aabb.max.y, model_aabb.max.y);
+			snap.scene_aabb.max.z = std::max(snap.scene_aabb.max.z, model_aabb.max.z);
+		}
 
-		shadow_fb->begin();
-		shadow_pip->begin();
+		{
+			profile_scope("Point light view");
 
-		for (auto view = world->new_view<Transform, Renderable3D>(); view.valid(); view.next()) {
-			auto& trans = view.get<Transform>();
-			auto& renderable = view.get<Renderable3D>();
+			for (ecs::View view = world->new_view<Transform, PointLight>(); view.valid(); view.next()) {
+				snap.lights.push_back(Snapshot::Light {
+					.light = view.get<PointLight>(),
+					.position = view.get<Transform>().m.get_translation()
+				});
+			}
+		}
 
-			shadow_pip->bind_descriptor_set(0, 0);
+		snap.camera = camera_ent.get<Camera>();
+	}
 
-			v_pc.transform = trans.m;
+	void Renderer3D::swap_snapshots() {
+		front_snapshot ^= 1;
+	}
 
-			v_pc.transform = trans.m;
-			for (auto mesh : renderable.model->meshes) {
-				scene_pip->push_constant(Pipeline::Stage::vertex, v_pc);
-				mesh->vb->bind();
-				mesh->ib->draw();
-			}
-		}
+	void Renderer3D::draw(ecs::World* world, ecs::Entity camera_ent) {
+		snapshot(world, camera_ent);
+		swap_snapshots();
+		draw();
+	}
+
+	void Renderer3D::draw() {
+		profile_function();
 
-		shadow_pip->end();
-		shadow_fb->end();
+		auto size = app->get_size();
 
-		const auto& camera = camera_ent.get<Camera>();
+		const auto& snap = snapshots[front_snapshot];
+		const auto& camera = snap.camera;
 
 		v3f cam_dir = v3f(
 			cosf(to_rad(camera.rotation.x)) * sinf(to_rad(camera.rotation.y)),
@@ -554,25 +1140,64 @@ namespace vkr {
 		v_ub.projection = m4f::pers(camera.fov, (f32)size.x / (f32)size.y, camera.near, camera.far);
 		v_ub.view = m4f::lookat(camera.position, camera.position + cam_dir, v3f(0.0f, 1.0f, 0.0f));
 
+		draw_shadows(camera, cam_dir, (f32)size.x / (f32)size.y, snap.scene_aabb);
+
 		f_ub.camera_pos = camera.position;
 		f_ub.near_plane = camera.near;
 		f_ub.far_plane = camera.far;
 		f_ub.aspect = (f32)size.x / (f32)size.y;
 		f_ub.fov = to_rad(camera.fov);
 
-		light_ub.point_light_count = 0;
-		for (ecs::View view = world->new_view<Transform, PointLight>(); view.valid(); view.next()) {
-			auto& trans = view.get<Transform>();
-			auto& light = view.get<PointLight>();
+		/* Cull point lights by their range against the view frustum. If
+		 * there are still too many, keep the ones that are likely to
+		 * contribute the most: bright, large and close to the camera. */
+		auto frustum = Frustum::from_matrix(v_ub.projection * v_ub.view);
+
+		stats.point_lights_total = snap.lights.size();
+		visible_lights.clear();
+		for (const auto& snap_light : snap.lights) {
+			const auto& light = snap_light.light;
+			v3f position = snap_light.position;
+
+			if (!frustum.contains_sphere(position, light.range)) { continue; }
+
+			f32 dist_sqrd = v3f::mag_sqrd(position - camera.position);
+			f32 range_sqrd = light.range * light.range;
+
+			visible_lights.push_back(VisibleLight {
+				.light = &light,
+				.position = position,
+				.importance = light.intensity * range_sqrd / (dist_sqrd + range_sqrd)
+			});
+		}
+
+		stats.point_lights_visible = visible_lights.size();
+		stats.point_lights_dropped = 0;
 
-			auto idx = light_ub.point_light_count++;
-			light_ub.point_lights[idx].intensity = light.intensity;
-			light_ub.point_lights[idx].diffuse = light.diffuse;
-			light_ub.point_lights[idx].specular = light.specular;
-			light_ub.point_lights[idx].position = trans.m.get_translation();
-			light_ub.point_lights[idx].range = light.range;
+		if (visible_lights.size() > max_point_lights) {
+			std::nth_element(visible_lights.begin(), visible_lights.begin() + max_point_lights, visible_lights.end(),
+				[](const VisibleLight& a, const VisibleLight& b) {
+					return a.importance > b.importance;
+				});
+
+			stats.point_lights_dropped = visible_lights.size() - max_point_lights;
+			visible_lights.resize(max_point_lights);
 		}
 
+		light_ub.point_light_count = (i32)visible_lights.size();
+		for (usize i = 0; i < visible_lights.size(); i++) {
+			const auto& visible = visible_lights[i];
+
+			point_lights[i].intensity = visible.light->intensity;
+			point_lights[i].diffuse = visible.light->diffuse;
+			point_lights[i].specular = visible.light->specular;
+			point_lights[i].position = visible.position;
+			point_lights[i].range = visible.light->range;
+		}
+
+		assign_light_clusters(v_ub.projection, camera.near, camera.far);
+		light_ub.inv_view_projection = (v_ub.projection * v_ub.view).inverse();
+
 		f_ub.sun.direction = sun.direction;
 		f_ub.sun.intensity = sun.intensity;
 		f_ub.sun.bias = sun.bias;
@@ -580,45 +1205,102 @@ namespace vkr {
 		f_ub.sun.diffuse = sun.diffuse;
 		f_ub.sun.specular = sun.specular;
 
-		f_ub.blocker_search_sample_count = sun.blocker_search_sample_count;
-		f_ub.pcf_sample_count = sun.pcf_sample_count;
+		/* The Poisson disk in poisson_disk.glsl has 64 points. */
+		i32 max_samples = sun.quality == ShadowQuality::pcss_low ? 16 : 64;
 
-		scene_pip->begin();
-		scene_fb->begin();
+		f_ub.shadow_quality = static_cast<i32>(sun.quality);
+		f_ub.blocker_search_sample_count = std::clamp(sun.blocker_search_sample_count, 1, max_samples);
+		f_ub.pcf_sample_count = std::clamp(sun.pcf_sample_count, 1, max_samples);
 
-		for (auto view = world->new_view<Transform, Renderable3D>(); view.valid(); view.next()) {
-			auto& trans = view.get<Transform>();
-			auto& renderable = view.get<Renderable3D>();
-			
-			auto model = renderable.model;
-			auto material_id = renderable.material_id;
+		const usize draw_count = snap.models.size();
 
-			this->model = model;
+		stats.scene_draws = 0;
+		for (auto model : snap.models) {
+			stats.scene_draws += model->meshes.size();
+		}
 
-			scene_pip->bind_descriptor_set(0, 0);
-			scene_pip->bind_descriptor_set(1, 1 + material_id);
+		/* Uploaded here, once, rather than in each Pipeline::begin, as the
+		 * passes may be recorded on several threads at once below and the
+		 * uniforms' offsets are shared between them. */
+		for (auto& cascade : cascades) {
+			if (cascade.stale) {
+				cascade.pip->upload_uniforms();
+			}
+		}
 
-			auto& material = materials[material_id];
+		scene_pip->upload_uniforms();
+
+		if (record_thread_count <= 1 || draw_count < parallel_record_threshold || app->video->is_frame_skipped()) {
+			for (auto& cascade : cascades) {
+				if (!cascade.stale) { continue; }
 
-			f_pc.use_diffuse_map = material.diffuse_map == null ? 0.0f : 1.0f;
-			f_pc.use_normal_map = material.normal_map == null ? 0.0f : 1.0f;
+				cascade.fb->begin();
+				record_shadow_casters(cascade);
+				cascade.fb->end();
+			}
 
-			f_pc.material.emissive = material.emissive;
-			f_pc.material.diffuse = material.diffuse;
-			f_pc.material.specular = material.specular;
-			f_pc.material.ambient = material.ambient;
+			scene_fb->begin();
+			record_scene(0, draw_count);
+			scene_fb->end();
+		} else {
+			/* Each stale cascade is a job, as is each of record_thread_count
+			 * even runs of the scene's draws. Every job records into a
+			 * command list of its own, so the workers can take them in any
+			 * order. */
+			while (scene_lists.size() < record_thread_count) {
+				scene_lists.push_back(new CommandList(app->video));
+			}
 
-			v_pc.transform = trans.m;
-			for (auto mesh : model->meshes) {
-				scene_pip->push_constant(Pipeline::Stage::vertex, v_pc);
-				scene_pip->push_constant(Pipeline::Stage::fragment, f_pc, sizeof(v_pc));
-				mesh->vb->bind();
-				mesh->ib->draw();
+			struct Job {
+				CommandList* list;
+				Framebuffer* fb;
+
+				const ShadowCascade* cascade;
+				usize first, last;
+			};
+
+			std::vector<Job> jobs;
+			for (const auto& cascade : cascades) {
+				if (cascade.stale) {
+					jobs.push_back(Job { cascade.list, cascade.fb, &cascade, 0, 0 });
+				}
 			}
-		}
 
-		scene_pip->end();
-		scene_fb->end();
+			const usize per_job = (draw_count + record_thread_count - 1) / record_thread_count;
+			for (usize i = 0; i < record_thread_count && i * per_job < draw_count; i++) {
+				jobs.push_back(Job { scene_lists[i], scene_fb, null, i * per_job, std::min((i + 1) * per_job, draw_count) });
+			}
+
+			workers->run(jobs.size(), [&](usize i) {
+				profile_scope("Record command list");
+
+				auto& job = jobs[i];
+
+				job.list->begin(job.fb);
+
+				if (job.cascade) {
+					record_shadow_casters(*job.cascade);
+				} else {
+					record_scene(job.first, job.last);
+				}
+
+				job.list->end();
+			});
+
+			/* Execute them in the order they would have been recorded in. */
+			usize job = 0;
+			for (; job < jobs.size() && jobs[job].cascade; job++) {
+				jobs[job].fb->begin(true);
+				jobs[job].list->execute();
+				jobs[job].fb->end();
+			}
+
+			scene_fb->begin(true);
+			for (; job < jobs.size(); job++) {
+				jobs[job].list->execute();
+			}
+			scene_fb->end();
+		}
 
 		f_post_ub.screen_size = v2f(static_cast<f32>(size.x), static_cast<f32>(size.y));
 		f_post_ub.camera_pos = camera.position;
@@ -626,17 +1308,365 @@ namespace vkr {
 		f_post_ub.bloom_blur_intensity = pp_config.bloom_blur_intensity;
 		f_post_ub.bloom_intensity = pp_config.bloom_intensity;
 
-		lighting->execute();
-		tonemap->execute();
-		bright_extract->execute();
-		blur_v->execute();
-		blur_h->execute();
-		blur_v2->execute();
-		blur_h2->execute();
+		post->execute();
+	}
+
+	void Renderer3D::record_shadow_casters(const ShadowCascade& cascade) {
+		/* A copy, as cascades can be recorded on several threads at once. */
+		auto pc = v_pc;
+
+		const auto& snap = snapshots[front_snapshot];
+
+		cascade.pip->begin(false);
+		cascade.pip->bind_descriptor_set(0, 0);
+
+		for (auto i : cascade.casters) {
+			pc.transform = snap.transforms[i];
+			for (auto mesh : snap.models[i]->meshes) {
+				cascade.pip->push_constant(Pipeline::Stage::vertex, pc);
+				mesh->vb->bind();
+				mesh->ib->draw();
+			}
+		}
+
+		cascade.pip->end();
+	}
+
+	void Renderer3D::record_scene(usize first, usize last) {
+		/* Copies, as runs of the scene can be recorded on several threads
+		 * at once. */
+		auto vertex_pc = v_pc;
+		auto fragment_pc = f_pc;
+
+		const auto& snap = snapshots[front_snapshot];
+
+		scene_pip->begin(false);
+		scene_pip->bind_descriptor_set(0, 0);
+
+		for (usize i = first; i < last; i++) {
+			auto material_id = snap.materials[i];
+			auto& material = materials[material_id];
+
+			scene_pip->bind_descriptor_set(1, 1 + material_id);
+
+			fragment_pc.use_diffuse_map = material.diffuse_map == null ? 0.0f : 1.0f;
+			fragment_pc.use_normal_map = material.normal_map == null ? 0.0f : 1.0f;
+
+			fragment_pc.material.emissive = material.emissive;
+			fragment_pc.material.diffuse = material.diffuse;
+			fragment_pc.material.specular = material.specular;
+			fragment_pc.material.ambient = material.ambient;
+
+			vertex_pc.transform = snap.transforms[i];
+			for (auto mesh : snap.models[i]->meshes) {
+				scene_pip->push_constant(Pipeline::Stage::vertex, vertex_pc);
+				scene_pip->push_constant(Pipeline::Stage::fragment, fragment_pc, sizeof(vertex_pc));
+				mesh->vb->bind();
+				mesh->ib->draw();
+			}
+		}
+
+		scene_pip->end();
+	}
+
+	/* Cascaded shadow maps for the sun.
+	 *
+	 * The view frustum up to shadow_distance is split by view depth and
+	 * each slice gets an orthographic projection around its bounding
+	 * sphere. The size of the sphere only depends on the camera's lens,
+	 * so turning the camera doesn't resize the projection, and its centre
+	 * is snapped to whole texels so that shadow edges don't crawl as the
+	 * camera moves.
+	 *
+	 * Cascades after the first are snapped more coarsely and grown to make
+	 * up for it, so they stay in place until the camera has moved some way.
+	 * They are then only re-rendered when that happens or when a caster
+	 * that overlaps them changes. */
+	void Renderer3D::draw_shadows(const Camera& camera, v3f cam_dir, f32 aspect, const AABB& scene_aabb) {
+		profile_function();
+
+		auto video = app->video;
+
+		const m4f light_view = m4f::lookat(
+			sun.direction,
+			v3f(0.0f, 0.0f, 0.0f),
+			v3f(0.0f, 1.0f, 0.0f));
+
+		const auto& snap = snapshots[front_snapshot];
+
+		light_aabbs.resize(snap.aabbs.size());
+		for (usize i = 0; i < snap.aabbs.size(); i++) {
+			light_aabbs[i] = m4f::transform(light_view, snap.aabbs[i]);
+		}
+
+		/* The depth range is shared by all of the cascades and covers the
+		 * whole scene, so that casters outside of the view still shadow it.
+		 * It is rounded out to a power of two, so that small movements don't
+		 * change it and with it every cascade. */
+		f32 near_depth = 0.0f;
+		f32 far_depth = 1.0f;
+		if (!snap.aabbs.empty()) {
+			AABB scene_ls = m4f::transform(light_view, scene_aabb);
+
+			near_depth = -scene_ls.max.z;
+			far_depth = -scene_ls.min.z;
+
+			f32 step = exp2f(ceilf(log2f(std::max(far_depth - near_depth, 1.0f) * 0.125f)));
+			near_depth = (floorf(near_depth / step) - 1.0f) * step;
+			far_depth = (ceilf(far_depth / step) + 1.0f) * step;
+		}
+
+		/* m4f::orth maps depths between (n + f) / 2 and f to 0..1, so the
+		 * near plane is moved back to have the scene land in that range. */
+		const f32 orth_near = 2.0f * near_depth - far_depth;
+
+		const f32 near = camera.near;
+		const f32 far = std::max(std::min(camera.far, sun.shadow_distance), near);
+		const f32 tan_y = tanf(to_rad(camera.fov) * 0.5f);
+		const f32 tan_x = tan_y * aspect;
+		const f32 k2 = tan_x * tan_x + tan_y * tan_y;
+
+		const u32 frame = video->get_current_frame();
+
+		f32 splits[shadow_cascade_count];
+		f32 scales[shadow_cascade_count];
+		f32 first_extent = 1.0f;
+
+		stats.shadow_cascades_rendered = 0;
+		stats.shadow_casters_drawn = 0;
+		stats.shadow_casters_skipped = 0;
+
+		f32 split_near = near;
+		for (usize i = 0; i < shadow_cascade_count; i++) {
+			auto cascade = cascades + i;
+
+			/* Blend between logarithmic and uniform splits. */
+			f32 p = (f32)(i + 1) / (f32)shadow_cascade_count;
+			f32 split_far =
+				sun.cascade_split_lambda * near * powf(far / near, p) +
+				(1.0f - sun.cascade_split_lambda) * (near + (far - near) * p);
+
+			/* Bounding sphere of the slice, centred on the view axis at
+			 * the point that is equally far from the near and far corners. */
+			f32 n = split_near, f = split_far;
+			f32 centre = std::min((f + n) * (1.0f + k2) * 0.5f, f);
+			f32 radius = std::max(
+				sqrtf((centre - n) * (centre - n) + n * n * k2),
+				sqrtf((f - centre) * (f - centre) + f * f * k2));
+			radius = ceilf(radius * 16.0f) / 16.0f;
+
+			f32 threshold = i == 0 ? 0.0f : shadow_cascade_update_threshold;
+			f32 extent = radius * (1.0f + threshold) + 2.0f * radius / (f32)shadow_cascade_res;
+			f32 texel = 2.0f * extent / (f32)shadow_cascade_res;
+			f32 step = std::max(texel, texel * floorf(radius * threshold / texel));
+
+			v4f c = light_view * v4f(camera.position + cam_dir * centre, 1.0f);
+			f32 cx = roundf(c.x / step) * step;
+			f32 cy = roundf(c.y / step) * step;
+
+			cascade->v_ub.view = light_view;
+			cascade->v_ub.projection = m4f::orth(
+				cx - extent, cx + extent,
+				cy - extent, cy + extent,
+				orth_near, far_depth);
+
+			m4f matrix = cascade->v_ub.projection * light_view;
+
+			/* Casters can only shadow the slice if they overlap it on the
+			 * light's xy plane and aren't entirely behind it. The volume is
+			 * open towards the light, as anything in that direction can
+			 * still cast into the slice. */
+			const f32 back_z = c.z - radius;
+
+			cascade->casters.clear();
+			u64 caster_keys = 0;
+			for (usize j = 0; j < light_aabbs.size(); j++) {
+				const auto& b = light_aabbs[j];
+
+				if (b.max.x < cx - extent || b.min.x > cx + extent ||
+					b.max.y < cy - extent || b.min.y > cy + extent ||
+					b.max.z < back_z) {
+					continue;
+				}
+
+				cascade->casters.push_back((u32)j);
+				caster_keys += snap.keys[j];
+			}
+
+			const usize caster_count = cascade->casters.size();
+
+			if (memcmp(&matrix, &cascade->matrix, sizeof(m4f)) != 0 ||
+				caster_count != cascade->caster_count ||
+				caster_keys != cascade->caster_keys) {
+				cascade->matrix = matrix;
+				cascade->caster_count = caster_count;
+				cascade->caster_keys = caster_keys;
+				cascade->version++;
+			}
+
+			if (i == 0) {
+				first_extent = extent;
+			}
+
+			splits[i] = split_far;
+			scales[i] = first_extent / extent;
+			f_ub.sun_matrices[i] = matrix;
+
+			split_near = split_far;
+
+			/* Drawn by draw(), along with the scene. */
+			cascade->stale = cascade->rendered_versions[frame] != cascade->version && !video->is_frame_skipped();
+			if (!cascade->stale) {
+				continue;
+			}
+
+			cascade->rendered_versions[frame] = cascade->version;
+			stats.shadow_cascades_rendered++;
+			stats.shadow_casters_drawn += caster_count;
+			stats.shadow_casters_skipped += snap.models.size() - caster_count;
+		}
+
+		static_assert(shadow_cascade_count == 4, "The cascade splits and scales are packed into a vec4.");
+		f_ub.cascade_splits = v4f(splits[0], splits[1], splits[2], splits[3]);
+		f_ub.cascade_scales = v4f(scales[0], scales[1], scales[2], scales[3]);
+	}
+
+	/* Light-centric assignment: each light's bounding box in view space is
+	 * projected to a range of tiles and depth slices, and the light is added
+	 * to every cluster in that range. This is conservative; the shader still
+	 * does the range check per pixel. */
+	void Renderer3D::assign_light_clusters(const m4f& projection, f32 near, f32 far) {
+		const usize light_count = (usize)light_ub.point_light_count;
+
+		light_ub.view = v_ub.view;
+
+		const f32 log_ratio = logf(far / near);
+		light_ub.cluster_z_scale = (f32)cluster_grid_z / log_ratio;
+		light_ub.cluster_z_bias = -(f32)cluster_grid_z * logf(near) / log_ratio;
+
+		auto slice = [&](f32 depth) -> u32 {
+			i32 z = (i32)(logf(depth) * light_ub.cluster_z_scale + light_ub.cluster_z_bias);
+			return (u32)std::clamp(z, 0, (i32)cluster_grid_z - 1);
+		};
+
+		auto tile = [](f32 ndc, usize count) -> u32 {
+			i32 t = (i32)((ndc * 0.5f + 0.5f) * (f32)count);
+			return (u32)std::clamp(t, 0, (i32)count - 1);
+		};
+
+		light_cluster_bounds.resize(light_count * 6);
+
+		point_lights_used_size = light_count * sizeof(impl_PointLight);
+
+		for (usize i = 0; i < cluster_count; i++) {
+			clusters[i].count = 0;
+		}
+
+		for (usize i = 0; i < light_count; i++) {
+			const auto& light = point_lights[i];
+			u32* bounds = light_cluster_bounds.data() + i * 6;
+
+			v4f vp = v_ub.view * v4f(light.position.x, light.position.y, light.position.z, 1.0f);
+			f32 depth = -vp.z;
+			f32 r = light.range;
+
+			if (depth + r < near || depth - r > far) {
+				/* Empty range. */
+				bounds[0] = 1; bounds[3] = 0;
+				continue;
+			}
+
+			bounds[2] = slice(std::max(depth - r, near));
+			bounds[5] = slice(std::min(depth + r, far));
+
+			if (depth - r <= near) {
+				/* The sphere reaches behind the near plane, where the
+				 * projection of its box isn't bounded. */
+				bounds[0] = 0; bounds[1] = 0;
+				bounds[3] = (u32)cluster_grid_x - 1; bounds[4] = (u32)cluster_grid_y - 1;
+			} else {
+				v2f mn(INFINITY, INFINITY);
+				v2f mx(-INFINITY, -INFINITY);
+
+				for (u32 c = 0; c < 8; c++) {
+					v4f corner(
+						vp.x + ((c & 1) ? r : -r),
+						vp.y + ((c & 2) ? r : -r),
+						vp.z + ((c & 4) ? r : -r),
+						1.0f);
+
+					v4f clip = projection * corner;
+					f32 x = clip.x / clip.w;
+					f32 y = clip.y / clip.w;
+
+					mn.x = std::min(mn.x, x); mn.y = std::min(mn.y, y);
+					mx.x = std::max(mx.x, x); mx.y = std::max(mx.y, y);
+				}
+
+				if (mx.x < -1.0f || mn.x > 1.0f || mx.y < -1.0f || mn.y > 1.0f) {
+					bounds[0] = 1; bounds[3] = 0;
+					continue;
+				}
+
+				bounds[0] = tile(mn.x, cluster_grid_x); bounds[1] = tile(mn.y, cluster_grid_y);
+				bounds[3] = tile(mx.x, cluster_grid_x); bounds[4] = tile(mx.y, cluster_grid_y);
+			}
+
+			for (u32 z = bounds[2]; z <= bounds[5]; z++) {
+				for (u32 y = bounds[1]; y <= bounds[4]; y++) {
+					for (u32 x = bounds[0]; x <= bounds[3]; x++) {
+						clusters[(z * cluster_grid_y + y) * cluster_grid_x + x].count++;
+					}
+				}
+			}
+		}
+
+		/* Prefix sum into offsets, truncating the lists that don't fit. */
+		u32 total = 0;
+		bool overflowed = false;
+		for (usize i = 0; i < cluster_count; i++) {
+			u32 count = clusters[i].count;
+			if (total + count > max_cluster_light_indices) {
+				count = (u32)max_cluster_light_indices - total;
+				overflowed = true;
+			}
+
+			clusters[i].offset = total;
+			clusters[i].count = 0;
+			total += count;
+		}
+
+		static bool warned = false;
+		if (overflowed && !warned) {
+			warning("Too many lights per cluster; some lights will be missing.");
+			warned = true;
+		}
+
+		cluster_light_indices_used_size = total * sizeof(u32);
+
+		for (usize i = 0; i < light_count; i++) {
+			const u32* bounds = light_cluster_bounds.data() + i * 6;
+
+			if (bounds[0] > bounds[3]) { continue; }
+
+			for (u32 z = bounds[2]; z <= bounds[5]; z++) {
+				for (u32 y = bounds[1]; y <= bounds[4]; y++) {
+					for (u32 x = bounds[0]; x <= bounds[3]; x++) {
+						usize idx = (z * cluster_grid_y + y) * cluster_grid_x + x;
+						auto& cluster = clusters[idx];
+
+						u32 end = idx + 1 < cluster_count ? clusters[idx + 1].offset : total;
+						if (cluster.offset + cluster.count >= end) { continue; }
+
+						cluster_light_indices[cluster.offset + cluster.count++] = (u32)i;
+					}
+				}
+			}
+		}
 	}
 
 	void Renderer3D::draw_to_default_framebuffer() {
-		composite->execute();
+		post->execute_to_default_framebuffer();
 	}
 
 	Mesh3D* Mesh3D::from_wavefront(Model3D* model, VideoContext* video, WavefrontModel* wmodel, WavefrontModel::Mesh* wmesh) {
@@ -734,6 +1764,8 @@ namespace vkr {
 	}
 
 	Model3D* Model3D::from_wavefront(VideoContext* video, WavefrontModel* wmodel) {
+		profile_function();
+
 		Model3D* model = new Model3D;
 
 		model->aabb = AABB {
@@ -759,6 +1791,8 @@ namespace vkr {
 	}
 
 	Bitmap* Bitmap::from_file(const char* path) {
+		profile_function();
+
 		u8* raw_data;
 		usize raw_size;
 
@@ -879,6 +1913,8 @@ namespace vkr {
 	}
 
 	Font::Font(const char* path, f32 size) {
+		profile_function();
+
 		handle = new impl_Font();
 
 		usize filesize;
@@ -961,8 +1997,9 @@ namespace vkr {
 		delete handle;
 	}
 
-	Renderer2D::Renderer2D(VideoContext* video, Shader* shader, Bitmap** images, usize image_count, Framebuffer* framebuffer)
-		: video(video), framebuffer(framebuffer), shader(shader), want_recreate(false) {
+	Renderer2D::Renderer2D(VideoContext* video, Shader* shader, Bitmap** images, usize image_count, Framebuffer* framebuffer,
+		usize max_quads) : video(video), framebuffer(framebuffer), max_quads(max_quads), shader(shader), want_recreate(false) {
+		stats = {};
 
 		for (usize i = 0; i < image_count; i++) {
 			sub_atlases[images[i]] = Rect{};
@@ -1084,8 +2121,16 @@ namespace vkr {
 	}
 
 	void Renderer2D::push(const Quad& quad) {
-		if (quad_count >= max_quads) {
-			warning("Too many quads.");
+		profile_function();
+
+		/* Writing past the end of the vertex buffer would corrupt it. */
+		if (quad_offset + quad_count >= max_quads) {
+			if (stats.quads_dropped == 0) {
+				warning("Too many quads.");
+			}
+
+			stats.quads_dropped++;
+			return;
 		}
 
 		auto x = roundf(quad.position.x);
@@ -1137,9 +2182,12 @@ namespace vkr {
 		vb->update(vertices, sizeof(vertices), (quad_offset + quad_count) * verts_per_quad * sizeof(Vertex));
 
 		quad_count++;
+		stats.quads++;
 	}
 
 	void Renderer2D::push(Font* font, const char* text, v2f position, v4f color) {
+		profile_function();
+
 		f32 x = position.x;
 		f32 y = position.y;
 
@@ -1185,6 +2233,8 @@ namespace vkr {
 
 			quad_offset += quad_count;
 			quad_count = 0;
+
+			stats.draws++;
 		}
 
 		pipeline->set_scissor(v4i(clip.x, clip.y, clip.w, clip.h));
@@ -1206,6 +2256,7 @@ namespace vkr {
 
 		quad_count = 0;
 		quad_offset = 0;
+		stats = {};
 		v_ub.projection = m4f::orth(0.0f, (f32)screen_size.x, 0.0f, (f32)screen_size.y, -1.0f, 1.0f);
 
 		pipeline->begin();
@@ -1219,5 +2270,7 @@ namespace vkr {
 		vb->bind();
 		vb->draw(quad_count * verts_per_quad, quad_offset * verts_per_quad);
 		pipeline->end();
+
+		stats.draws++;
 	}
 }
@@ -0,0 +1,347 @@
+#include <stdio.h>
+#include <string.h> /* memcpy */
+
+#include "profiler.hpp"
+#include "scene.hpp"
+#include "renderer.hpp"
+#include "vkr.hpp"
+#include "workers.hpp"
+
+namespace vkr {
+	SceneSerialiser::SceneSerialiser(ecs::World* world) : world(world) {
+		world->register_component<Transform>(hash_string("vkr::Transform"));
+		world->register_component<PointLight>(hash_string("vkr::PointLight"));
+		world->register_component<Camera>(hash_string("vkr::Camera"));
+
+		/* The model pointer is swapped with the path hash in place; the
+		 * two have the same size, so the layout of Renderable3D doesn't
+		 * change. */
+		static_assert(sizeof(Model3D*) == sizeof(u64));
+
+		world->register_component<Renderable3D>(hash_string("vkr::Renderable3D"),
+			[this](ecs::World&, void* ptr) {
+				Renderable3D* r = (Renderable3D*)ptr;
+
+				u64 hash = 0;
+				if (model_hashes.count(r->model) != 0) {
+					hash = model_hashes[r->model];
+				} else if (r->model) {
+					warning("Saving a Renderable3D with a model that wasn't registered with the scene serialiser.");
+				}
+
+				memcpy(&r->model, &hash, sizeof(hash));
+			},
+			[this](ecs::World&, void* ptr) {
+				Renderable3D* r = (Renderable3D*)ptr;
+
+				u64 hash;
+				memcpy(&hash, &r->model, sizeof(hash));
+
+				r->model = null;
+				if (models.count(hash) != 0) {
+					r->model = models[hash];
+				} else if (hash != 0) {
+					warning("Loading a Renderable3D with a model that wasn't registered with the scene serialiser.");
+				}
+			});
+	}
+
+	void SceneSerialiser::add_model(const char* path, Model3D* model) {
+		u64 hash = hash_string(path);
+
+		models[hash] = model;
+		model_hashes[model] = hash;
+	}
+
+	bool SceneSerialiser::save(const char* path) {
+		profile_function();
+
+		FILE* file = fopen(path, "wb");
+		if (!file) {
+			error("Failed to fopen `%s' for writing.", path);
+			return false;
+		}
+
+		usize size = world->snapshot_size();
+		u8* buffer = new u8[size];
+
+		world->write_snapshot(buffer);
+
+		bool ok = fwrite(buffer, 1, size, file) == size;
+		if (!ok) {
+			error("Failed to write scene to `%s'.", path);
+		}
+
+		delete[] buffer;
+		fclose(file);
+
+		return ok;
+	}
+
+	bool SceneSerialiser::load(const char* path) {
+		profile_function();
+
+		u8* buffer;
+		usize size;
+
+		if (!read_raw(path, &buffer, &size)) {
+			return false;
+		}
+
+		bool ok = world->read_snapshot(buffer, size);
+		if (!ok) {
+			error("`%s' is not a valid scene file.", path);
+		}
+
+		delete[] buffer;
+
+		return ok;
+	}
+
+	m4f LocalTransform::get_matrix() const {
+		m4f r = m4f::translate(m4f::identity(), translation);
+		r = m4f::rotate(r, to_rad(rotation.y), v3f(0.0f, 1.0f, 0.0f));
+		r = m4f::rotate(r, to_rad(rotation.x), v3f(1.0f, 0.0f, 0.0f));
+		r = m4f::rotate(r, to_rad(rotation.z), v3f(0.0f, 0.0f, 1.0f));
+		return m4f::scale(r, scale);
+	}
+
+	TransformHierarchy::TransformHierarchy(ecs::World* world, WorkerPool* workers) :
+		world(world), last_tick(0), workers(workers), want_rebuild(true) {
+		world->add_tick_reader(&last_tick);
+	}
+
+	TransformHierarchy::~TransformHierarchy() {
+		world->remove_tick_reader(&last_tick);
+	}
+
+	void TransformHierarchy::invalidate() {
+		want_rebuild = true;
+	}
+
+	bool TransformHierarchy::structure_changed() {
+		if (want_rebuild) { return true; }
+
+		bool changed = false;
+		auto on_removed = [&](ecs::Entity_Handle) { changed = true; };
+
+		world->each_removed<LocalTransform>(last_tick, on_removed);
+		world->each_removed<Parent>(last_tick, on_removed);
+
+		/* Views have to be run to the end, so these don't break out early. */
+		for (auto view = world->new_view<LocalTransform>().added<LocalTransform>(last_tick); view.valid(); view.next()) {
+			changed = true;
+		}
+
+		for (auto view = world->new_view<Parent>().changed<Parent>(last_tick); view.valid(); view.next()) {
+			changed = true;
+		}
+
+		return changed;
+	}
+
+	/* Removing a component moves the last one in its pool into the gap,
+	 * and adding one may reallocate the pool, so the cached pointers
+	 * are only good as long as neither has happened to either pool.
+	 * Removals from the LocalTransform pool already cause a rebuild. */
+	bool TransformHierarchy::pools_moved() {
+		if (nodes.empty()) { return false; }
+
+		bool moved = false;
+		world->each_removed<Transform>(last_tick, [&](ecs::Entity_Handle) { moved = true; });
+		if (moved) { return true; }
+
+		/* A reallocation moves every component, including the first node's. */
+		ecs::Entity first(nodes[0].handle, world);
+		return &first.get<LocalTransform>() != locals[0] || &first.get<Transform>().m != worlds[0];
+	}
+
+	void TransformHierarchy::rebuild() {
+		nodes.clear();
+		node_indices.clear();
+		roots.clear();
+
+		std::vector<ecs::Entity_Handle> root_handles;
+		std::unordered_map<ecs::Entity_Handle, std::vector<ecs::Entity_Handle>> children;
+
+		usize total = 0;
+
+		for (auto view = world->new_view<LocalTransform>(); view.valid(); view.next()) {
+			ecs::Entity e = view.get_entity();
+			total++;
+
+			if (e.has<Parent>()) {
+				ecs::Entity p = e.get<Parent>().entity;
+				if (p.valid() && p.has<LocalTransform>()) {
+					children[p.get_handle()].push_back(e.get_handle());
+					continue;
+				}
+			}
+
+			root_handles.push_back(e.get_handle());
+		}
+
+		nodes.reserve(total);
+
+		/* Iterative depth-first walk; each stack entry holds the
+		 * node's handle and the index of its parent in nodes. */
+		std::vector<Node> stack;
+		for (auto root : root_handles) {
+			roots.push_back(nodes.size());
+
+			stack.push_back(Node { root, -1 });
+			while (!stack.empty()) {
+				Node node = stack.back();
+				stack.pop_back();
+
+				i64 idx = (i64)nodes.size();
+				node_indices[node.handle] = (usize)idx;
+				nodes.push_back(node);
+
+				auto it = children.find(node.handle);
+				if (it != children.end()) {
+					for (auto child : it->second) {
+						stack.push_back(Node { child, idx });
+					}
+				}
+			}
+		}
+
+		roots.push_back(nodes.size());
+
+		if (nodes.size() != total) {
+			warning("%llu entities are part of a parenting cycle and won't be transformed.",
+				(unsigned long long)(total - nodes.size()));
+		}
+
+		want_rebuild = false;
+	}
+
+	/* Returns true if any node had to be given a Transform. */
+	bool TransformHierarchy::cache_components() {
+		const usize count = nodes.size();
+
+		/* Adding components may grow the pools, so this is done before
+		 * any pointers are taken. A node that has only just been given a
+		 * Transform needs it filling in. */
+		bool added = false;
+		for (usize i = 0; i < count; i++) {
+			ecs::Entity e(nodes[i].handle, world);
+			if (!e.has<Transform>()) {
+				e.add(Transform { m4f::identity() });
+				dirty[i] = 1;
+				added = true;
+			}
+		}
+
+		locals.resize(count);
+		worlds.resize(count);
+
+		for (usize i = 0; i < count; i++) {
+			ecs::Entity e(nodes[i].handle, world);
+
+			locals[i] = &e.get<LocalTransform>();
+			worlds[i] = &e.get<Transform>().m;
+		}
+
+		return added;
+	}
+
+	void TransformHierarchy::propagate(usize first_root, usize last_root) {
+		for (usize i = roots[first_root]; i < roots[last_root]; i++) {
+			i64 parent = nodes[i].parent;
+
+			if (parent >= 0) {
+				dirty[i] |= dirty[parent];
+
+				if (dirty[i]) {
+					*worlds[i] = *worlds[parent] * locals[i]->get_matrix();
+				}
+			} else if (dirty[i]) {
+				*worlds[i] = locals[i]->get_matrix();
+			}
+		}
+	}
+
+	void TransformHierarchy::update() {
+		profile_function();
+
+		bool full = structure_changed();
+		if (full) {
+			rebuild();
+		}
+
+		const usize count = nodes.size();
+
+		dirty.assign(count, full ? 1 : 0);
+		bool any_dirty = full && count > 0;
+
+		if (full || pools_moved()) {
+			any_dirty |= cache_components();
+		}
+
+		if (!full) {
+			for (auto view = world->new_view<LocalTransform>().changed<LocalTransform>(last_tick); view.valid(); view.next()) {
+				auto it = node_indices.find(view.get_entity().get_handle());
+
+				/* Entities in a parenting cycle aren't nodes. */
+				if (it != node_indices.end()) {
+					dirty[it->second] = 1;
+					any_dirty = true;
+				}
+			}
+		}
+
+		if (any_dirty) {
+			propagate_dirty();
+		}
+
+		last_tick = world->advance_tick();
+	}
+
+	void TransformHierarchy::propagate_dirty() {
+		const usize count = nodes.size();
+		const usize root_count = roots.size() - 1;
+		const usize thread_count = workers ? workers->get_thread_count() : 1;
+		const usize job_count = thread_count < root_count ? thread_count : root_count;
+
+		if (job_count <= 1 || count < parallel_threshold) {
+			propagate(0, root_count);
+		} else {
+			/* Split the roots into contiguous runs of roughly equal
+			 * node counts. Subtrees never cross a run, so the jobs
+			 * don't touch each other's nodes. */
+			std::vector<usize> runs;
+			runs.reserve(job_count + 1);
+
+			const usize per_job = (count + job_count - 1) / job_count;
+
+			usize first = 0;
+			runs.push_back(first);
+			for (usize i = 0; i < job_count && first < root_count; i++) {
+				usize last = first + 1;
+				while (last < root_count && roots[last] - roots[first] < per_job) {
+					last++;
+				}
+
+				if (i == job_count - 1) {
+					last = root_count;
+				}
+
+				runs.push_back(last);
+				first = last;
+			}
+
+			workers->run(runs.size() - 1, [&](usize i) {
+				propagate(runs[i], runs[i + 1]);
+			});
+		}
+
+		for (usize i = 0; i < count; i++) {
+			if (dirty[i]) {
+				ecs::Entity(nodes[i].handle, world).mark_changed<Transform>();
+			}
+		}
+	}
+
+}
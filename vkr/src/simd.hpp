@@ -0,0 +1,117 @@
+#pragma once
+
+/* Thin wrapper over the SIMD instruction set of the target, used by the
+ * maths kernels. Everything works on four packed floats. Define VKR_NO_SIMD
+ * to force the scalar fallback. */
+
+#include "common.hpp"
+
+#if defined(VKR_NO_SIMD)
+	#define VKR_SIMD_NONE
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#define VKR_SIMD_SSE
+	#include <xmmintrin.h>
+	#ifdef __AVX__
+		#define VKR_SIMD_AVX
+		#include <immintrin.h>
+	#endif
+#elif (defined(__ARM_NEON) && defined(__aarch64__)) || defined(_M_ARM64)
+	#define VKR_SIMD_NEON
+	#include <arm_neon.h>
+#else
+	#define VKR_SIMD_NONE
+#endif
+
+#ifndef VKR_SIMD_NONE
+
+namespace vkr {
+namespace simd {
+#if defined(VKR_SIMD_SSE)
+	typedef __m128 f32x4;
+
+	inline f32x4 load(const f32* p)            { return _mm_loadu_ps(p); }
+	inline void  store(f32* p, f32x4 v)        { _mm_storeu_ps(p, v); }
+	inline void  store3(f32* p, f32x4 v)       { _mm_storel_pi((__m64*)p, v); _mm_store_ss(p + 2, _mm_movehl_ps(v, v)); }
+	inline f32x4 set1(f32 v)                   { return _mm_set1_ps(v); }
+	inline f32x4 set(f32 x, f32 y, f32 z, f32 w) { return _mm_setr_ps(x, y, z, w); }
+	inline f32x4 add(f32x4 a, f32x4 b)         { return _mm_add_ps(a, b); }
+	inline f32x4 sub(f32x4 a, f32x4 b)         { return _mm_sub_ps(a, b); }
+	inline f32x4 mul(f32x4 a, f32x4 b)         { return _mm_mul_ps(a, b); }
+	inline f32x4 div(f32x4 a, f32x4 b)         { return _mm_div_ps(a, b); }
+	inline f32x4 min(f32x4 a, f32x4 b)         { return _mm_min_ps(a, b); }
+	inline f32x4 max(f32x4 a, f32x4 b)         { return _mm_max_ps(a, b); }
+	inline f32x4 abs(f32x4 a)                  { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+	inline f32   first(f32x4 a)                { return _mm_cvtss_f32(a); }
+
+	/* Returns (v[x], v[y], v[z], v[w]). */
+	template <int x, int y, int z, int w>
+	inline f32x4 shuffle(f32x4 v) {
+		return _mm_shuffle_ps(v, v, _MM_SHUFFLE(w, z, y, x));
+	}
+
+	inline void transpose(f32x4& a, f32x4& b, f32x4& c, f32x4& d) {
+		_MM_TRANSPOSE4_PS(a, b, c, d);
+	}
+#elif defined(VKR_SIMD_NEON)
+	typedef float32x4_t f32x4;
+
+	inline f32x4 load(const f32* p)            { return vld1q_f32(p); }
+	inline void  store(f32* p, f32x4 v)        { vst1q_f32(p, v); }
+	inline void  store3(f32* p, f32x4 v)       { vst1_f32(p, vget_low_f32(v)); vst1q_lane_f32(p + 2, v, 2); }
+	inline f32x4 set1(f32 v)                   { return vdupq_n_f32(v); }
+	inline f32x4 set(f32 x, f32 y, f32 z, f32 w) { const f32 v[] = { x, y, z, w }; return vld1q_f32(v); }
+	inline f32x4 add(f32x4 a, f32x4 b)         { return vaddq_f32(a, b); }
+	inline f32x4 sub(f32x4 a, f32x4 b)         { return vsubq_f32(a, b); }
+	inline f32x4 mul(f32x4 a, f32x4 b)         { return vmulq_f32(a, b); }
+	inline f32x4 div(f32x4 a, f32x4 b)         { return vdivq_f32(a, b); }
+	inline f32x4 min(f32x4 a, f32x4 b)         { return vminq_f32(a, b); }
+	inline f32x4 max(f32x4 a, f32x4 b)         { return vmaxq_f32(a, b); }
+	inline f32x4 abs(f32x4 a)                  { return vabsq_f32(a); }
+	inline f32   first(f32x4 a)                { return vgetq_lane_f32(a, 0); }
+
+	template <int x, int y, int z, int w>
+	inline f32x4 shuffle(f32x4 v) {
+	#if defined(__clang__) || defined(__GNUC__)
+		return __builtin_shufflevector(v, v, x, y, z, w);
+	#else
+		return set(vgetq_lane_f32(v, x), vgetq_lane_f32(v, y), vgetq_lane_f32(v, z), vgetq_lane_f32(v, w));
+	#endif
+	}
+
+	inline void transpose(f32x4& a, f32x4& b, f32x4& c, f32x4& d) {
+		float32x4x2_t ab = vtrnq_f32(a, b);
+		float32x4x2_t cd = vtrnq_f32(c, d);
+
+		a = vcombine_f32(vget_low_f32(ab.val[0]),  vget_low_f32(cd.val[0]));
+		b = vcombine_f32(vget_low_f32(ab.val[1]),  vget_low_f32(cd.val[1]));
+		c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+		d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+	}
+#endif
+
+	/* a * b + c. */
+	inline f32x4 madd(f32x4 a, f32x4 b, f32x4 c) {
+		return add(mul(a, b), c);
+	}
+
+	template <int i>
+	inline f32x4 splat(f32x4 v) {
+		return shuffle<i, i, i, i>(v);
+	}
+
+	/* Cross product of the xyz parts; w comes out as zero. */
+	inline f32x4 cross(f32x4 a, f32x4 b) {
+		return sub(
+			mul(shuffle<1, 2, 0, 3>(a), shuffle<2, 0, 1, 3>(b)),
+			mul(shuffle<2, 0, 1, 3>(a), shuffle<1, 2, 0, 3>(b)));
+	}
+
+	/* Sum of all four lanes, in every lane. */
+	inline f32x4 hsum(f32x4 v) {
+		v = add(v, shuffle<1, 0, 3, 2>(v));
+		return add(v, shuffle<2, 3, 0, 1>(v));
+	}
+}
+}
+
+#endif
@@ -4,6 +4,7 @@
 
 #include <algorithm>
 
+#include "profiler.hpp"
 #include "ui.hpp"
 #include "vkr.hpp"
 
@@ -173,6 +174,8 @@ namespace vkr {
 	}
 
 	void UIContext::draw(Renderer2D* renderer) {
+		profile_function();
+
 		#define commit_clip(cmd_) \
 					if (rect_outside_clip((cmd_)->position, (cmd_)->dimentions, current_clip)) { \
 						renderer->set_clip(current_clip); \
@@ -443,6 +446,31 @@ namespace vkr {
 		column = 0;
 	}
 
+	void UIContext::gpu_timings(const VideoContext* video) {
+		const auto& timings = video->get_gpu_timings();
+
+		columns(2, 0.7, 0.3);
+
+		if (timings.empty()) {
+			label("No GPU timings.");
+			label("");
+			return;
+		}
+
+		f64 total = 0.0;
+		for (const auto& timing : timings) {
+			if (timing.depth == 0) {
+				total += timing.ms;
+			}
+
+			text("%*s%s", (int)timing.depth * 2, "", timing.name);
+			text("%.3fms", timing.ms);
+		}
+
+		label("Total");
+		text("%.3fms", total);
+	}
+
 	void UIContext::advance(f32 last_height) {
 		if (last_height > current_item_height) {
 			current_item_height = last_height;
@@ -3,6 +3,7 @@
 #include <set>
 #include <vector>
 
+#include <stdio.h>
 #include <string.h>
 
 #include <vulkan/vulkan.h>
@@ -10,11 +11,13 @@
 
 #include "vkr.hpp"
 #include "internal.hpp"
+#include "profiler.hpp"
 
 /* The vulkan spec only requires 128 byte
  * push constants, so that's the maximum that
  * this renderer will use. */
 #define max_push_const_size 128
+#define max_dynamic_offsets 16
 
 namespace vkr {
 	static const char* validation_layers[] = {
@@ -78,17 +81,36 @@ namespace vkr {
 		return avail_formats[0];
 	}
 
-	/* If available, VK_PRESENT_MODE_MAILBOX_KHR is used. Otherwise, it will default to VK_PRESENT_MODE_FIFO_KHR.
-	 *
-	 * This is basically just what kind of VSync to use. */
-	static VkPresentModeKHR choose_swap_present_mode(u32 avail_present_mode_count, VkPresentModeKHR* avail_present_modes) {
+	/* This is basically just what kind of VSync to use. FIFO is the only
+	 * mode that has to be supported, so it's the fallback. */
+	static VkPresentModeKHR choose_swap_present_mode(VideoContext::PresentMode wanted,
+		u32 avail_present_mode_count, VkPresentModeKHR* avail_present_modes) {
+
+		VkPresentModeKHR mode;
+		const char* name;
+
+		switch (wanted) {
+			case VideoContext::PresentMode::fifo:
+				return VK_PRESENT_MODE_FIFO_KHR;
+			case VideoContext::PresentMode::mailbox:
+				mode = VK_PRESENT_MODE_MAILBOX_KHR;
+				name = "VK_PRESENT_MODE_MAILBOX_KHR";
+				break;
+			case VideoContext::PresentMode::immediate:
+				mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+				name = "VK_PRESENT_MODE_IMMEDIATE_KHR";
+				break;
+			default:
+				return VK_PRESENT_MODE_FIFO_KHR;
+		}
+
 		for (u32 i = 0; i < avail_present_mode_count; i++) {
-			if (avail_present_modes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
+			if (avail_present_modes[i] == mode) {
 				return avail_present_modes[i];
 			}
 		}
 
-		warning("VK_PRESENT_MODE_MAILBOX_KHR is not supported.");
+		warning("%s is not supported.", name);
 
 		return VK_PRESENT_MODE_FIFO_KHR;
 	}
@@ -122,8 +144,15 @@ namespace vkr {
 				r.graphics = i;
 			}
 
+			/* Without a surface there's nothing to present to, so the
+			 * graphics queue stands in for the present queue. */
 			VkBool32 supports_presentation = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, handle->surface, &supports_presentation);
+			if (handle->surface != VK_NULL_HANDLE) {
+				vkGetPhysicalDeviceSurfaceSupportKHR(device, i, handle->surface, &supports_presentation);
+			} else {
+				supports_presentation = (families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+			}
+
 			if (supports_presentation) {
 				r.present = i;
 			}
@@ -163,7 +192,9 @@ namespace vkr {
 		return true;
 	}
 
-	static VkPhysicalDevice first_suitable_device(VkPhysicalDevice* devices, u32 device_count, impl_VideoContext* handle) {
+	/* Headless contexts don't need the swapchain, and take CPU
+	 * implementations such as lavapipe too. */
+	static VkPhysicalDevice first_suitable_device(VkPhysicalDevice* devices, u32 device_count, impl_VideoContext* handle, bool headless) {
 		for (u32 i = 0; i < device_count; i++) {
 			auto device = devices[i];
 
@@ -174,9 +205,9 @@ namespace vkr {
 
 			auto qfs = get_queue_families(device, handle);
 
-			bool swap_chain_good = false;
-			bool extensions_good = device_supports_extensions(device);
-			if (extensions_good) {
+			bool swap_chain_good = headless;
+			bool extensions_good = headless || device_supports_extensions(device);
+			if (extensions_good && !headless) {
 				SwapChainCapabilities scc = get_swap_chain_capabilities(handle, device);
 				swap_chain_good = scc.format_count > 0 && scc.present_mode_count > 0;
 				scc.free();
@@ -186,7 +217,8 @@ namespace vkr {
 			 * have a queue capable of executing graphical commands. */
 			if (
 					(props.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU ||
-					props.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU) &&
+					props.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ||
+					(headless && props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU)) &&
 					features.samplerAnisotropy &&
 					extensions_good && swap_chain_good &&
 					qfs.graphics.has_value() && qfs.present.has_value()) {
@@ -350,7 +382,7 @@ namespace vkr {
 	}
 
 	static void change_image_layout(impl_VideoContext* handle, VkImage image, VkFormat format,
-		VkImageLayout src_layout, VkImageLayout dst_layout, bool is_depth = false) {
+		VkImageLayout src_layout, VkImageLayout dst_layout, bool is_depth = false, u32 mip_levels = 1) {
 
 		auto command_buffer = begin_temp_command_buffer(handle);
 
@@ -363,7 +395,7 @@ namespace vkr {
 		barrier.image = image;
 		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		barrier.subresourceRange.baseMipLevel = 0;
-		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.levelCount = mip_levels;
 		barrier.subresourceRange.baseArrayLayer = 0;
 		barrier.subresourceRange.layerCount = 1;
 
@@ -416,7 +448,8 @@ namespace vkr {
 
 	static void new_image(impl_VideoContext* handle, v2i size, VkFormat format,
 		VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags props,
-		VkImage* image, VmaAllocation* image_memory, VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED, bool is_depth = false) {
+		VkImage* image, VmaAllocation* image_memory, VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED, bool is_depth = false,
+		u32 mip_levels = 1) {
 
 		VkImageCreateInfo create_info{};
 		create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -424,7 +457,7 @@ namespace vkr {
 		create_info.extent.width = (u32)size.x;
 		create_info.extent.height = (u32)size.y;
 		create_info.extent.depth = 1;
-		create_info.mipLevels = 1;
+		create_info.mipLevels = mip_levels;
 		create_info.arrayLayers = 1;
 		create_info.format = format;
 		create_info.tiling = tiling;
@@ -442,7 +475,7 @@ namespace vkr {
 		}
 
 		if (layout != VK_IMAGE_LAYOUT_UNDEFINED) {
-			change_image_layout(handle, *image, format, VK_IMAGE_LAYOUT_UNDEFINED, layout, is_depth);
+			change_image_layout(handle, *image, format, VK_IMAGE_LAYOUT_UNDEFINED, layout, is_depth, mip_levels);
 		}
 	}
 
@@ -459,7 +492,80 @@ namespace vkr {
 		end_temp_command_buffer(handle, command_buffer);
 	}
 
-	static VkImageView new_image_view(impl_VideoContext* handle, VkImage image, VkFormat format, VkImageAspectFlags flags, VkImageViewType type = VK_IMAGE_VIEW_TYPE_2D) {
+	/* Fills in each level of the mip chain after the first by blitting the
+	 * level above it into it. Every level must start out in
+	 * VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL; they all end up in
+	 * VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL. */
+	static void generate_mipmaps(impl_VideoContext* handle, VkImage image, v2i size, u32 mip_levels) {
+		auto command_buffer = begin_temp_command_buffer(handle);
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+
+		i32 w = size.x, h = size.y;
+		for (u32 i = 1; i < mip_levels; i++) {
+			i32 next_w = std::max(w / 2, 1);
+			i32 next_h = std::max(h / 2, 1);
+
+			barrier.subresourceRange.baseMipLevel = i - 1;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+			vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				0, 0, null, 0, null, 1, &barrier);
+
+			VkImageBlit blit{};
+			blit.srcOffsets[1] = { w, h, 1 };
+			blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			blit.srcSubresource.mipLevel = i - 1;
+			blit.srcSubresource.layerCount = 1;
+			blit.dstOffsets[1] = { next_w, next_h, 1 };
+			blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			blit.dstSubresource.mipLevel = i;
+			blit.dstSubresource.layerCount = 1;
+
+			vkCmdBlitImage(command_buffer,
+				image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				1, &blit, VK_FILTER_LINEAR);
+
+			/* Nothing reads from this level again until it's sampled. */
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+			vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+				0, 0, null, 0, null, 1, &barrier);
+
+			w = next_w;
+			h = next_h;
+		}
+
+		/* The last level is only ever blitted into. */
+		barrier.subresourceRange.baseMipLevel = mip_levels - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, 0, null, 0, null, 1, &barrier);
+
+		end_temp_command_buffer(handle, command_buffer);
+	}
+
+	static VkImageView new_image_view(impl_VideoContext* handle, VkImage image, VkFormat format, VkImageAspectFlags flags,
+		VkImageViewType type = VK_IMAGE_VIEW_TYPE_2D, u32 mip_levels = 1) {
 		VkImageViewCreateInfo iv_create_info{};
 		iv_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 		iv_create_info.image = image;
@@ -467,7 +573,7 @@ namespace vkr {
 		iv_create_info.format = format;
 		iv_create_info.subresourceRange.aspectMask = flags;
 		iv_create_info.subresourceRange.baseMipLevel = 0;
-		iv_create_info.subresourceRange.levelCount = 1;
+		iv_create_info.subresourceRange.levelCount = mip_levels;
 		iv_create_info.subresourceRange.baseArrayLayer = 0;
 		iv_create_info.subresourceRange.layerCount = 1;
 
@@ -507,6 +613,16 @@ namespace vkr {
 	}
 
 
+	static VkFormat find_packed_float_format(impl_VideoContext* handle) {
+		VkFormat formats[] = {
+			VK_FORMAT_B10G11R11_UFLOAT_PACK32,
+			VK_FORMAT_R16G16B16A16_SFLOAT
+		};
+
+		return find_supported_format(handle, formats, 2, VK_IMAGE_TILING_OPTIMAL,
+			VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+	}
+
 	static VkFormat fb_format(impl_VideoContext* handle, Framebuffer::Attachment::Format format) {
 #define fmt(v_) format == Framebuffer::Attachment::Format::v_
 
@@ -521,6 +637,8 @@ namespace vkr {
 			fmt(redf16)  ? VK_FORMAT_R16_SFLOAT :
 			fmt(rgbf16)  ? VK_FORMAT_R16G16B16_SFLOAT :
 			fmt(rgbaf16) ? VK_FORMAT_R16G16B16A16_SFLOAT :
+			fmt(rgf16)   ? VK_FORMAT_R16G16_SFLOAT :
+			fmt(r11g11b10f) ? find_packed_float_format(handle) :
 			VK_FORMAT_R8G8B8_UNORM;
 #undef fmt
 	}
@@ -610,8 +728,114 @@ namespace vkr {
 		}
 	}
 
+	/* What Pipeline, VertexBuffer and IndexBuffer record into on this thread:
+	 * a CommandList while one is being recorded, otherwise the command
+	 * buffer of the current frame. */
+	static thread_local VkCommandBuffer recording_list = VK_NULL_HANDLE;
+
+	static VkCommandBuffer current_command_buffer(VideoContext* video) {
+		if (recording_list != VK_NULL_HANDLE) {
+			return recording_list;
+		}
+
+		return video->handle->command_buffers[video->get_current_frame()];
+	}
+
+	/* The header that starts the data of every pipeline cache. The data is
+	 * only any use to the same driver on the same device, so it's checked
+	 * against this before it's given to Vulkan. */
+	struct PipelineCacheHeader {
+		u32 size;
+		u32 version;
+		u32 vendor_id;
+		u32 device_id;
+		u8 uuid[VK_UUID_SIZE];
+	};
+
+	static void init_pipeline_cache(impl_VideoContext* handle) {
+		u8* data = null;
+		usize size = 0;
+
+		FILE* file = fopen(pipeline_cache_path, "rb");
+		if (file) {
+			fseek(file, 0, SEEK_END);
+			size = (usize)ftell(file);
+			fseek(file, 0, SEEK_SET);
+
+			data = new u8[size];
+			if (fread(data, 1, size, file) < size) {
+				size = 0;
+			}
+
+			fclose(file);
+		}
+
+		if (size > 0) {
+			VkPhysicalDeviceProperties props;
+			vkGetPhysicalDeviceProperties(handle->pdevice, &props);
+
+			PipelineCacheHeader header;
+			bool valid = size >= sizeof(header);
+			if (valid) {
+				memcpy(&header, data, sizeof(header));
+
+				valid =
+					header.size >= sizeof(header) &&
+					header.version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+					header.vendor_id == props.vendorID &&
+					header.device_id == props.deviceID &&
+					memcmp(header.uuid, props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+			}
+
+			if (!valid) {
+				info("Pipeline cache `%s' is from a different device or driver; ignoring it.", pipeline_cache_path);
+				size = 0;
+			}
+		}
+
+		VkPipelineCacheCreateInfo cache_info{};
+		cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		cache_info.initialDataSize = size;
+		cache_info.pInitialData = size > 0 ? data : null;
+
+		if (vkCreatePipelineCache(handle->device, &cache_info, null, &handle->pipeline_cache) != VK_SUCCESS) {
+			abort_with("Failed to create pipeline cache.");
+		}
+
+		delete[] data;
+	}
+
+	static void save_pipeline_cache(impl_VideoContext* handle) {
+		usize size = 0;
+		if (vkGetPipelineCacheData(handle->device, handle->pipeline_cache, &size, null) != VK_SUCCESS || size == 0) {
+			return;
+		}
+
+		u8* data = new u8[size];
+		if (vkGetPipelineCacheData(handle->device, handle->pipeline_cache, &size, data) != VK_SUCCESS) {
+			delete[] data;
+			return;
+		}
+
+		FILE* file = fopen(pipeline_cache_path, "wb");
+		if (!file) {
+			warning("Failed to fopen `%s' for writing; the pipeline cache won't be saved.", pipeline_cache_path);
+			delete[] data;
+			return;
+		}
+
+		if (fwrite(data, 1, size, file) < size) {
+			warning("Failed to write the pipeline cache to `%s'.", pipeline_cache_path);
+		}
+
+		fclose(file);
+		delete[] data;
+	}
+
 	VideoContext::VideoContext(const App& app, const char* app_name, bool enable_validation_layers, u32 extension_count, const char** extensions)
-			: current_frame(0), app(app), want_recreate(false), validation_layers_enabled(enable_validation_layers) {
+			: current_frame(0), image_id(0), app(app), headless(app.headless), present_mode(PresentMode::mailbox),
+			gpu_timers(false), want_recreate(false),
+			validation_layers_enabled(enable_validation_layers) {
 		handle = new impl_VideoContext();
 
 		if (enable_validation_layers && !validation_layers_supported()) {
@@ -676,7 +900,9 @@ namespace vkr {
 		}
 
 		/* Create the window surface */
-		if (!app.create_window_surface(*this)) {
+		if (headless) {
+			handle->surface = VK_NULL_HANDLE;
+		} else if (!app.create_window_surface(*this)) {
 			abort_with("Failed to create a window surface.");
 		}
 
@@ -692,7 +918,7 @@ namespace vkr {
 
 		vkEnumeratePhysicalDevices(handle->instance, &device_count, devices);
 
-		handle->pdevice = first_suitable_device(devices, device_count, handle);
+		handle->pdevice = first_suitable_device(devices, device_count, handle, headless);
 		if (handle->pdevice == VK_NULL_HANDLE) {
 			error("first_suitable_device() failed.");
 			info("Vulkan-capable hardware exists, but it does not support the required features.");
@@ -700,6 +926,7 @@ namespace vkr {
 		}
 
 		auto qfs = get_queue_families(handle->pdevice, handle);
+		handle->graphics_family = qfs.graphics.value();
 
 		std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
 		std::set<u32> unique_queue_families = { qfs.graphics.value(), qfs.present.value() };
@@ -722,8 +949,10 @@ namespace vkr {
 		device_create_info.pQueueCreateInfos = &queue_create_infos[0];
 		device_create_info.queueCreateInfoCount = (u32)queue_create_infos.size();
 		device_create_info.pEnabledFeatures = &device_features;
-		device_create_info.enabledExtensionCount = sizeof(device_extensions) / sizeof(*device_extensions);
-		device_create_info.ppEnabledExtensionNames = device_extensions;
+		if (!headless) {
+			device_create_info.enabledExtensionCount = sizeof(device_extensions) / sizeof(*device_extensions);
+			device_create_info.ppEnabledExtensionNames = device_extensions;
+		}
 
 		if (vkCreateDevice(handle->pdevice, &device_create_info, null, &handle->device) != VK_SUCCESS) {
 			abort_with("Failed to create a Vulkan device.");
@@ -748,7 +977,63 @@ namespace vkr {
 
 		vmaCreateAllocator(&allocator_info, &handle->allocator);
 
-		init_swapchain();
+		init_pipeline_cache(handle);
+
+		/* Create the uniform ring. */
+		{
+			VkPhysicalDeviceProperties props;
+			vkGetPhysicalDeviceProperties(handle->pdevice, &props);
+
+			auto& ring = handle->uniform_ring;
+			ring.offset = 0;
+			ring.slot_base = uniform_ring_size;
+			ring.alignment = (usize)std::max(
+				props.limits.minUniformBufferOffsetAlignment,
+				props.limits.minStorageBufferOffsetAlignment);
+			ring.frame = 0;
+
+			for (usize i = 0; i < max_frames_in_flight; i++) {
+				new_buffer(handle, uniform_ring_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT, ring.buffers + i, ring.memories + i);
+
+				vmaMapMemory(handle->allocator, ring.memories[i], (void**)(ring.datas + i));
+			}
+		}
+
+		/* Create the timestamp query pools. */
+		{
+			VkPhysicalDeviceProperties props;
+			vkGetPhysicalDeviceProperties(handle->pdevice, &props);
+
+			auto& timers = handle->gpu_timers;
+			timers.supported = props.limits.timestampComputeAndGraphics == VK_TRUE;
+			timers.period = (f64)props.limits.timestampPeriod;
+			timers.active = false;
+
+			VkQueryPoolCreateInfo query_pool_info{};
+			query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			query_pool_info.queryCount = max_gpu_timestamps;
+
+			for (usize i = 0; i < max_frames_in_flight; i++) {
+				timers.pools[i] = VK_NULL_HANDLE;
+				timers.query_counts[i] = 0;
+
+				if (timers.supported && vkCreateQueryPool(handle->device, &query_pool_info, null, &timers.pools[i]) != VK_SUCCESS) {
+					warning("Failed to create a timestamp query pool.");
+					timers.supported = false;
+				}
+			}
+
+			if (!timers.supported) {
+				warning("GPU timers are not supported.");
+			}
+		}
+
+		if (!headless) {
+			init_swapchain();
+		}
 
 		/* Create the command pool. */
 		VkCommandPoolCreateInfo pool_info{};
@@ -803,11 +1088,24 @@ namespace vkr {
 		 * The default framebuffer does not have a depth attachment,
 		 * which means off-screen rendering needs to be used if 3-D
 		 * rendering is required. This is fine because most of the time
-		 * you want to do post-processing anyhow. */
-		default_fb = new Framebuffer(this,
-			Framebuffer::Flags::default_fb | Framebuffer::Flags::fit,
-			app.get_size(),
-			attachments, 1);
+		 * you want to do post-processing anyhow.
+		 *
+		 * Without a swapchain, it's an off-screen framebuffer that can
+		 * be read back instead. */
+		if (headless) {
+			attachments[0].format = Framebuffer::Attachment::Format::rgba8;
+
+			default_fb = new Framebuffer(this,
+				Framebuffer::Flags::headless | Framebuffer::Flags::fit,
+				app.get_size(),
+				attachments, 1);
+		} else {
+			default_fb = new Framebuffer(this,
+				Framebuffer::Flags::default_fb | Framebuffer::Flags::fit,
+				app.get_size(),
+				attachments, 1);
+		}
+		default_fb->set_gpu_timer_name("default framebuffer");
 	}
 
 	VideoContext::~VideoContext() {
@@ -819,18 +1117,41 @@ namespace vkr {
 
 		vkDestroyCommandPool(handle->device, handle->command_pool, null);
 
+		for (u32 i = 0; i < max_frames_in_flight; i++) {
+			if (handle->gpu_timers.pools[i] != VK_NULL_HANDLE) {
+				vkDestroyQueryPool(handle->device, handle->gpu_timers.pools[i], null);
+			}
+		}
+
 		delete default_fb;
 
-		for (u32 i = 0; i < handle->swapchain_image_count; i++) {
-			vkDestroyImageView(handle->device, handle->swapchain_image_views[i], null);
+		if (!headless) {
+			for (u32 i = 0; i < handle->swapchain_image_count; i++) {
+				vkDestroyImageView(handle->device, handle->swapchain_image_views[i], null);
+			}
+
+			vkDestroySwapchainKHR(handle->device, handle->swapchain, null);
 		}
 
-		vkDestroySwapchainKHR(handle->device, handle->swapchain, null);
+		for (usize i = 0; i < max_frames_in_flight; i++) {
+			vmaUnmapMemory(handle->allocator, handle->uniform_ring.memories[i]);
+			vmaDestroyBuffer(handle->allocator, handle->uniform_ring.buffers[i], handle->uniform_ring.memories[i]);
+		}
+
+		for (auto& pair : handle->uniform_ring.entries) {
+			delete[] pair.second.contents;
+		}
+
+		save_pipeline_cache(handle);
+		vkDestroyPipelineCache(handle->device, handle->pipeline_cache, null);
 
 		vmaDestroyAllocator(handle->allocator);
 
 		vkDestroyDevice(handle->device, null);
-		vkDestroySurfaceKHR(handle->instance, handle->surface, null);
+
+		if (!headless) {
+			vkDestroySurfaceKHR(handle->instance, handle->surface, null);
+		}
 
 		if (are_validation_layers_enabled()) {
 			destroy_debug_utils_messenger_ext(handle->instance, handle->messenger, null);
@@ -852,7 +1173,7 @@ namespace vkr {
 		/* Create the swap chain. */
 		SwapChainCapabilities scc = get_swap_chain_capabilities(handle, handle->pdevice);
 		VkSurfaceFormatKHR surface_format = choose_swap_surface_format(scc.format_count, scc.formats);
-		VkPresentModeKHR present_mode = choose_swap_present_mode(scc.present_mode_count, scc.present_modes);
+		VkPresentModeKHR present_mode = choose_swap_present_mode(this->present_mode, scc.present_mode_count, scc.present_modes);
 		VkExtent2D extent = choose_swap_extent(app, scc.capabilities);
 
 		handle->swapchain_format = surface_format.format;
@@ -928,14 +1249,72 @@ namespace vkr {
 		delete[] handle->swapchain_image_views;
 	}
 
+	static void read_gpu_timers(impl_VideoContext* handle, u32 frame, std::vector<VideoContext::GPUTiming>& timings) {
+		auto& timers = handle->gpu_timers;
+		auto& scopes = timers.scopes[frame];
+
+		if (scopes.empty()) { return; }
+
+		u64 stamps[max_gpu_timestamps];
+		VkResult r = vkGetQueryPoolResults(handle->device, timers.pools[frame], 0, timers.query_counts[frame],
+			sizeof(stamps), stamps, sizeof(u64), VK_QUERY_RESULT_64_BIT);
+
+		if (r == VK_SUCCESS) {
+			timings.clear();
+
+			for (const auto& scope : scopes) {
+				timings.push_back(VideoContext::GPUTiming {
+					.name = scope.name,
+					.depth = scope.depth,
+					.ms = (f64)(stamps[scope.end] - stamps[scope.begin]) * timers.period / 1000000.0
+				});
+			}
+		}
+
+		scopes.clear();
+		timers.query_counts[frame] = 0;
+	}
+
 	void VideoContext::begin() {
 		object_count = 0;
 		skip_frame = false;
 
-		vkWaitForFences(handle->device, 1, &handle->in_flight_fences[current_frame], VK_TRUE, UINT64_MAX);
+		{
+			profile_scope("Wait for the frame's fence");
+			vkWaitForFences(handle->device, 1, &handle->in_flight_fences[current_frame], VK_TRUE, UINT64_MAX);
+		}
 
-		VkResult r;
-		if (!want_recreate) {
+		/* The GPU is done with this frame's ring, so it can be reused. */
+		{
+			auto& ring = handle->uniform_ring;
+
+			ring.frame++;
+			ring.offset = 0;
+
+			ring.free_slots.insert(ring.free_slots.end(), ring.released_slots.begin(), ring.released_slots.end());
+			ring.released_slots.clear();
+
+			for (auto it = ring.entries.begin(); it != ring.entries.end();) {
+				if (ring.frame - it->second.last_frame > uniform_slot_max_idle_frames) {
+					ring.free_slots.push_back(it->second.slot);
+					delete[] it->second.contents;
+					it = ring.entries.erase(it);
+				} else {
+					++it;
+				}
+			}
+		}
+
+		/* And its timestamps can be read without waiting. */
+		read_gpu_timers(handle, current_frame, gpu_timings);
+		handle->gpu_timers.active = false;
+
+		if (!gpu_timers) {
+			gpu_timings.clear();
+		}
+
+		VkResult r = VK_SUCCESS;
+		if (!want_recreate && !headless) {
 			r = vkAcquireNextImageKHR(handle->device, handle->swapchain, UINT64_MAX,
 				handle->image_avail_semaphores[current_frame], VK_NULL_HANDLE, &image_id);
 		}
@@ -960,11 +1339,27 @@ namespace vkr {
 			warning("Failed to begin the command buffer.");
 			return;
 		}
+
+		auto& timers = handle->gpu_timers;
+		timers.active = gpu_timers && timers.supported;
+		timers.open.clear();
+
+		if (timers.active) {
+			vkCmdResetQueryPool(handle->command_buffers[current_frame], timers.pools[current_frame], 0, max_gpu_timestamps);
+		}
 	}
 
 	void VideoContext::end() {
+		profile_function();
+
 		if (skip_frame) { return; }
 
+		/* Unended timers would leave their queries unwritten, and with
+		 * them the whole frame's results unavailable. */
+		while (!handle->gpu_timers.open.empty()) {
+			end_gpu_timer();
+		}
+
 		if (vkEndCommandBuffer(handle->command_buffers[current_frame]) != VK_SUCCESS) {
 			warning("Failed to end the command buffer");
 			return;
@@ -977,19 +1372,28 @@ namespace vkr {
 
 		VkSubmitInfo submit_info{};
 		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submit_info.waitSemaphoreCount = 1;
-		submit_info.pWaitSemaphores = wait_semaphores;
-		submit_info.pWaitDstStageMask = wait_stages;
 		submit_info.commandBufferCount = 1;
 		submit_info.pCommandBuffers = &handle->command_buffers[current_frame];
-		submit_info.signalSemaphoreCount = 1;
-		submit_info.pSignalSemaphores = signal_semaphores;
+
+		/* Without a swapchain, there's no image to wait for or to present. */
+		if (!headless) {
+			submit_info.waitSemaphoreCount = 1;
+			submit_info.pWaitSemaphores = wait_semaphores;
+			submit_info.pWaitDstStageMask = wait_stages;
+			submit_info.signalSemaphoreCount = 1;
+			submit_info.pSignalSemaphores = signal_semaphores;
+		}
 
 		if (vkQueueSubmit(handle->graphics_queue, 1, &submit_info, handle->in_flight_fences[current_frame]) != VK_SUCCESS) {
 			warning("Failed to submit draw command buffer.");
 			return;
 		}
 
+		if (headless) {
+			current_frame = (current_frame + 1) % max_frames_in_flight;
+			return;
+		}
+
 		VkSwapchainKHR swapchains[] = { handle->swapchain };
 
 		VkPresentInfoKHR present_info{};
@@ -1006,16 +1410,167 @@ namespace vkr {
 		current_frame = (current_frame + 1) % max_frames_in_flight;
 	}
 
+	static impl_UniformRing::Slot alloc_uniform_slot(impl_UniformRing& ring, usize capacity) {
+		/* First fit; slots are few, and mostly the same few sizes. */
+		for (usize i = 0; i < ring.free_slots.size(); i++) {
+			if (ring.free_slots[i].capacity >= capacity) {
+				auto slot = ring.free_slots[i];
+				ring.free_slots[i] = ring.free_slots.back();
+				ring.free_slots.pop_back();
+				return slot;
+			}
+		}
+
+		if (capacity > ring.slot_base || ((ring.slot_base - capacity) & ~(ring.alignment - 1)) < ring.offset) {
+			abort_with("Uniform ring out of memory. Increase uniform_ring_size.");
+		}
+
+		ring.slot_base = (ring.slot_base - capacity) & ~(ring.alignment - 1);
+
+		return impl_UniformRing::Slot { ring.slot_base, capacity };
+	}
+
+	u32 VideoContext::upload_uniform(const void* ptr, usize size, usize reserve) {
+		auto& ring = handle->uniform_ring;
+
+		std::lock_guard<std::mutex> lock(ring.mutex);
+
+		const usize capacity = std::max(size, reserve);
+		u8* data = ring.datas[current_frame];
+
+		auto it = ring.entries.find(ptr);
+		if (it == ring.entries.end() || it->second.slot.capacity < capacity) {
+			if (it != ring.entries.end()) {
+				ring.released_slots.push_back(it->second.slot);
+				delete[] it->second.contents;
+				ring.entries.erase(it);
+			}
+
+			impl_UniformRing::Entry entry{};
+			entry.slot = alloc_uniform_slot(ring, capacity);
+			entry.contents = new u8[capacity];
+			entry.version = 1;
+			entry.last_frame = ring.frame - 1;
+
+			it = ring.entries.emplace(ptr, entry).first;
+		}
+
+		auto& e = it->second;
+		bool same = e.size == size && memcmp(e.contents, ptr, size) == 0;
+
+		if (e.last_frame != ring.frame) {
+			if (!same) {
+				memcpy(e.contents, ptr, size);
+				e.size = size;
+				e.version++;
+			}
+
+			if (e.written[current_frame] != e.version) {
+				memcpy(data + e.slot.offset, ptr, size);
+				e.written[current_frame] = e.version;
+			}
+
+			e.last_frame = ring.frame;
+			e.current_offset = e.slot.offset;
+
+			return (u32)e.current_offset;
+		}
+
+		if (same) {
+			return (u32)e.current_offset;
+		}
+
+		usize offset = (ring.offset + ring.alignment - 1) & ~(ring.alignment - 1);
+		if (offset + capacity > ring.slot_base) {
+			abort_with("Uniform ring out of memory. Increase uniform_ring_size.");
+		}
+
+		memcpy(data + offset, ptr, size);
+		memcpy(e.contents, ptr, size);
+		e.size = size;
+		e.version++;
+		e.current_offset = offset;
+
+		ring.offset = offset + capacity;
+
+		return (u32)offset;
+	}
+
+	u32 VideoContext::get_frames_in_flight() const {
+		return max_frames_in_flight;
+	}
+
+	VideoContext::MemoryUsage VideoContext::get_memory_usage() const {
+		VmaTotalStatistics stats;
+		vmaCalculateStatistics(handle->allocator, &stats);
+
+		return MemoryUsage {
+			.allocated = static_cast<usize>(stats.total.statistics.allocationBytes),
+			.reserved  = static_cast<usize>(stats.total.statistics.blockBytes)
+		};
+	}
+
 	void VideoContext::wait_for_done() const {
 		vkDeviceWaitIdle(handle->device);
 	}
 
+	void VideoContext::begin_gpu_timer(const char* name) {
+		auto& timers = handle->gpu_timers;
+
+		if (skip_frame || !timers.active) { return; }
+
+		auto& scopes = timers.scopes[current_frame];
+		auto& count = timers.query_counts[current_frame];
+
+		if (count + 2 > max_gpu_timestamps) {
+			/* Out of queries; ended without writing anything. */
+			timers.open.push_back(SIZE_MAX);
+			return;
+		}
+
+		scopes.push_back(impl_GPUTimers::Scope {
+			.name = name,
+			.depth = (u32)timers.open.size(),
+			.begin = count,
+			.end = count + 1
+		});
+
+		count += 2;
+
+		timers.open.push_back(scopes.size() - 1);
+
+		vkCmdWriteTimestamp(handle->command_buffers[current_frame], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			timers.pools[current_frame], scopes.back().begin);
+	}
+
+	void VideoContext::end_gpu_timer() {
+		auto& timers = handle->gpu_timers;
+
+		if (skip_frame || !timers.active || timers.open.empty()) { return; }
+
+		usize scope = timers.open.back();
+		timers.open.pop_back();
+
+		if (scope == SIZE_MAX) { return; }
+
+		vkCmdWriteTimestamp(handle->command_buffers[current_frame], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			timers.pools[current_frame], timers.scopes[current_frame][scope].end);
+	}
+
+	void VideoContext::set_present_mode(PresentMode mode) {
+		if (mode == present_mode) { return; }
+
+		present_mode = mode;
+		want_recreate = true;
+	}
+
 	void VideoContext::resize(v2i new_size) {
 		wait_for_done();
 
-		deinit_swapchain();
-
-		init_swapchain();
+		if (!headless) {
+			deinit_swapchain();
+			init_swapchain();
+		}
 
 		for (auto fb : framebuffers) {
 			if (fb->flags & Framebuffer::Flags::fit) {
@@ -1082,26 +1637,12 @@ namespace vkr {
 		input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 		input_assembly.primitiveRestartEnable = VK_FALSE;
 
-		auto scaled_fb_size = framebuffer->get_scaled_size();
-
-		VkViewport viewport{};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width  = static_cast<f32>(scaled_fb_size.x);
-		viewport.height = static_cast<f32>(scaled_fb_size.y);
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-
-		VkRect2D scissor{};
-		scissor.offset = { 0, 0 };
-		scissor.extent = { (u32)scaled_fb_size.x, (u32)scaled_fb_size.y };
-
+		/* The viewport and scissor are dynamic and set in begin(), so that
+		 * the pipeline doesn't depend on the size of its framebuffer. */
 		VkPipelineViewportStateCreateInfo viewport_state{};
 		viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 		viewport_state.viewportCount = 1;
-		viewport_state.pViewports = &viewport;
 		viewport_state.scissorCount = 1;
-		viewport_state.pScissors = &scissor;
 
 		VkPipelineRasterizationStateCreateInfo rasteriser{};
 		rasteriser.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -1163,7 +1704,7 @@ namespace vkr {
 		color_blending.pAttachments = color_blend_attachments;
 
 		/* Count the descriptors of different types to create a descriptor pool. */
-		sampler_count = uniform_count = 0;
+		sampler_count = uniform_count = storage_count = 0;
 		for (usize i = 0; i < desc_set_count; i++) {
 			auto set = desc_sets + i;
 
@@ -1178,6 +1719,10 @@ namespace vkr {
 					case ResourcePointer::Type::uniform_buffer:
 						uniform_count++;
 						break;
+					case ResourcePointer::Type::storage_buffer:
+						uniform_count++;
+						storage_count++;
+						break;
 					default:
 						abort_with("Invalid resource pointer type on descriptor.");
 						break;
@@ -1186,13 +1731,20 @@ namespace vkr {
 		}
 
 		/* Create the descriptor pool. */
-		VkDescriptorPoolSize pool_sizes[2];
+		VkDescriptorPoolSize pool_sizes[3];
 		usize pool_size_count = 0;
-		if (uniform_count > 0) {
+		if (uniform_count - storage_count > 0) {
+			auto idx = pool_size_count++;
+
+			pool_sizes[idx].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			pool_sizes[idx].descriptorCount = max_frames_in_flight * (u32)(uniform_count - storage_count);
+		}
+
+		if (storage_count > 0) {
 			auto idx = pool_size_count++;
 
-			pool_sizes[idx].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			pool_sizes[idx].descriptorCount = max_frames_in_flight * (u32)uniform_count;
+			pool_sizes[idx].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+			pool_sizes[idx].descriptorCount = max_frames_in_flight * (u32)storage_count;
 		}
 
 		if (sampler_count > 0) {
@@ -1218,12 +1770,15 @@ namespace vkr {
 		handle->uniforms = new impl_UniformBuffer[uniform_count]();
 		auto set_layouts = new VkDescriptorSetLayout[desc_set_count]();
 
+		usize uniform_base = 0;
 		for (usize i = 0; i < desc_set_count; i++) {
 			auto set = desc_sets + i;
 			auto v_set = handle->desc_sets + i;
 
 			auto layout_bindings = new VkDescriptorSetLayoutBinding[set->count]();
 
+			usize dynamic_count = 0;
+
 			for (usize ii = 0; ii < set->count; ii++) {
 				auto desc = set->descriptors + ii;
 
@@ -1235,7 +1790,12 @@ namespace vkr {
 						lb->descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 						break;
 					case ResourcePointer::Type::uniform_buffer:
-						lb->descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+						lb->descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+						dynamic_count++;
+						break;
+					case ResourcePointer::Type::storage_buffer:
+						lb->descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+						dynamic_count++;
 						break;
 					default:
 						abort_with("Invalid resource pointer type on descriptor.");
@@ -1277,22 +1837,53 @@ namespace vkr {
 				abort_with("Failed to allocate descriptor sets.");
 			}
 
+			if (dynamic_count > max_dynamic_offsets) {
+				abort_with("Too many uniform and storage buffers in one descriptor set.");
+			}
+
+			/* Dynamic offsets are passed in binding order, so remember
+			 * which uniform each one comes from. */
+			v_set->dynamic_uniforms = new usize[dynamic_count];
+			v_set->dynamic_count = 0;
+			u32* dynamic_bindings = new u32[dynamic_count];
+
 			auto image_infos = new VkDescriptorImageInfo[max_frames_in_flight];
 			usize image_info_count = 0;
 			auto buffer_infos = new VkDescriptorBufferInfo[max_frames_in_flight];
 			usize buffer_info_count = 0;
 
-			/* Write the descriptor set and create uniform buffers if necessary. */
-			for (usize ii = 0, ui = 0; ii < set->count; ii++) {
+			/* Write the descriptor set. Uniform and storage buffers point into
+			 * the uniform ring of each frame and are offset when bound. */
+			for (usize ii = 0; ii < set->count; ii++) {
 				VkWriteDescriptorSet desc_writes[max_frames_in_flight] = {};
 
 				usize uniform_index;
 
 				if (set->descriptors[ii].resource.type == ResourcePointer::Type::uniform_buffer) {
-						uniform_index = ui++;
+						uniform_index = uniform_base++;
 
 						handle->uniforms[uniform_index].ptr = set->descriptors[ii].resource.uniform.ptr;
 						handle->uniforms[uniform_index].size = set->descriptors[ii].resource.uniform.size;
+				} else if (set->descriptors[ii].resource.type == ResourcePointer::Type::storage_buffer) {
+						uniform_index = uniform_base++;
+
+						handle->uniforms[uniform_index].ptr = set->descriptors[ii].resource.storage.ptr;
+						handle->uniforms[uniform_index].size = set->descriptors[ii].resource.storage.size;
+						handle->uniforms[uniform_index].used_size = set->descriptors[ii].resource.storage.used_size;
+				}
+
+				if (set->descriptors[ii].resource.type == ResourcePointer::Type::uniform_buffer ||
+					set->descriptors[ii].resource.type == ResourcePointer::Type::storage_buffer) {
+					/* Insertion sort by binding; sets are small. */
+					usize at = v_set->dynamic_count++;
+					while (at > 0 && dynamic_bindings[at - 1] > set->descriptors[ii].binding) {
+						dynamic_bindings[at] = dynamic_bindings[at - 1];
+						v_set->dynamic_uniforms[at] = v_set->dynamic_uniforms[at - 1];
+						at--;
+					}
+
+					dynamic_bindings[at] = set->descriptors[ii].binding;
+					v_set->dynamic_uniforms[at] = uniform_index;
 				}
 
 				image_info_count = 0;
@@ -1335,20 +1926,23 @@ namespace vkr {
 							write->pImageInfo = image_info;
 						} break;
 						case ResourcePointer::Type::uniform_buffer: {
-							new_buffer(video->handle, (VkDeviceSize)handle->uniforms[uniform_index].size,
-								VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-								VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-								VMA_ALLOCATION_CREATE_MAPPED_BIT,
-								handle->uniforms[uniform_index].buffers + j,
-								handle->uniforms[uniform_index].memories + j);
+							auto buffer_info = buffer_infos + (buffer_info_count++);
+
+							buffer_info->buffer = video->handle->uniform_ring.buffers[j];
+							buffer_info->offset = 0;
+							buffer_info->range = handle->uniforms[uniform_index].size;
 
+							write->descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+							write->pBufferInfo = buffer_info;
+						} break;
+						case ResourcePointer::Type::storage_buffer: {
 							auto buffer_info = buffer_infos + (buffer_info_count++);
 
-							buffer_info->buffer = handle->uniforms[uniform_index].buffers[j];
+							buffer_info->buffer = video->handle->uniform_ring.buffers[j];
 							buffer_info->offset = 0;
 							buffer_info->range = handle->uniforms[uniform_index].size;
 
-							write->descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+							write->descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
 							write->pBufferInfo = buffer_info;
 						} break;
 						default:
@@ -1362,6 +1956,7 @@ namespace vkr {
 
 			delete[] image_infos;
 			delete[] buffer_infos;
+			delete[] dynamic_bindings;
 
 			delete[] layout_bindings;
 		}
@@ -1386,16 +1981,14 @@ namespace vkr {
 			abort_with("Failed to create pipeline layout.");
 		}
 
-		VkDynamicState dynamic_states[2];
-
-		u32 dynamic_state_count = 0;
-		if (flags & Flags::dynamic_scissor) {
-			dynamic_states[dynamic_state_count++] = VK_DYNAMIC_STATE_SCISSOR;
-		}
+		VkDynamicState dynamic_states[] = {
+			VK_DYNAMIC_STATE_VIEWPORT,
+			VK_DYNAMIC_STATE_SCISSOR
+		};
 
 		VkPipelineDynamicStateCreateInfo dynamic_state{};
 		dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-		dynamic_state.dynamicStateCount = dynamic_state_count;
+		dynamic_state.dynamicStateCount = 2;
 		dynamic_state.pDynamicStates = dynamic_states;
 
 		VkGraphicsPipelineCreateInfo pipeline_info{};
@@ -1414,7 +2007,7 @@ namespace vkr {
 		pipeline_info.renderPass = framebuffer->handle->render_pass;
 		pipeline_info.subpass = 0;
 
-		if (vkCreateGraphicsPipelines(video->handle->device, VK_NULL_HANDLE, 1, &pipeline_info, null, &handle->pipeline) != VK_SUCCESS) {
+		if (vkCreateGraphicsPipelines(video->handle->device, video->handle->pipeline_cache, 1, &pipeline_info, null, &handle->pipeline) != VK_SUCCESS) {
 			abort_with("Failed to create pipeline.");
 		}
 
@@ -1442,18 +2035,12 @@ namespace vkr {
 				video->pipelines.end());
 		}
 
-		for (usize i = 0; i < uniform_count; i++) {
-			for (u32 ii = 0; ii < max_frames_in_flight; ii++) {
-				vmaDestroyBuffer(video->handle->allocator,
-						handle->uniforms[i].buffers[ii],
-						handle->uniforms[i].memories[ii]);
-			}
-		}
-
 		for (usize i = 0; i < descriptor_set_count; i++) {
 			auto set = handle->desc_sets + i;
 
 			vkDestroyDescriptorSetLayout(video->handle->device, set->layout, null);
+
+			delete[] set->dynamic_uniforms;
 		}
 
 		vkDestroyDescriptorPool(video->handle->device, handle->descriptor_pool, null);
@@ -1467,22 +2054,49 @@ namespace vkr {
 		delete handle;
 	}
 
-	void Pipeline::begin() {
+	void Pipeline::upload_uniforms() {
 		if (video->skip_frame) { return; }
 
-		video->pipeline = this;
-
-		/* Update the uniform buffers. */
 		for (u32 i = 0; i < uniform_count; i++) {
 			auto u = handle->uniforms + i;
 
-			void* uniform_data;
-			vmaMapMemory(video->handle->allocator, u->memories[video->current_frame], &uniform_data);
-			memcpy(uniform_data, u->ptr, u->size);
-			vmaUnmapMemory(video->handle->allocator, u->memories[video->current_frame]);
+			if (u->used_size) {
+				u->offset = video->upload_uniform(u->ptr, std::min(*u->used_size, u->size), u->size);
+			} else {
+				u->offset = video->upload_uniform(u->ptr, u->size);
+			}
+		}
+	}
+
+	void Pipeline::begin(bool upload) {
+		if (video->skip_frame) { return; }
+
+		if (upload) {
+			upload_uniforms();
 		}
 
-		vkCmdBindPipeline(video->handle->command_buffers[video->current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, handle->pipeline);
+		auto cb = current_command_buffer(video);
+
+		vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, handle->pipeline);
+
+		auto size = framebuffer->get_scaled_size();
+
+		VkViewport viewport = {
+			.x = 0.0f,
+			.y = 0.0f,
+			.width  = (f32)size.x,
+			.height = (f32)size.y,
+			.minDepth = 0.0f,
+			.maxDepth = 1.0f
+		};
+
+		VkRect2D scissor = {
+			.offset = { 0, 0 },
+			.extent = { (u32)size.x, (u32)size.y }
+		};
+
+		vkCmdSetViewport(cb, 0, 1, &viewport);
+		vkCmdSetScissor(cb, 0, 1, &scissor);
 	}
 
 	void Pipeline::end() {
@@ -1504,7 +2118,7 @@ namespace vkr {
 			}
 		};
 
-		vkCmdSetScissor(video->handle->command_buffers[video->current_frame], 0, 1, &scissor);
+		vkCmdSetScissor(current_command_buffer(video), 0, 1, &scissor);
 	}
 
 	void Pipeline::push_constant(Stage stage, const void* ptr, usize size, usize offset) {
@@ -1515,7 +2129,7 @@ namespace vkr {
 			abort_with("Push constant too big. Use a uniform buffer instead.");
 		}
 #endif
-		vkCmdPushConstants(video->handle->command_buffers[video->current_frame], handle->pipeline_layout,
+		vkCmdPushConstants(current_command_buffer(video), handle->pipeline_layout,
 			stage == Stage::vertex ?
 				VK_SHADER_STAGE_VERTEX_BIT :
 				VK_SHADER_STAGE_FRAGMENT_BIT,
@@ -1525,26 +2139,60 @@ namespace vkr {
 	void Pipeline::bind_descriptor_set(usize target, usize index) {
 		if (video->skip_frame) { return; }
 
-		vkCmdBindDescriptorSets(video->handle->command_buffers[video->current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS,
+		auto set = handle->desc_sets + index;
+
+		u32 offsets[max_dynamic_offsets];
+		for (usize i = 0; i < set->dynamic_count; i++) {
+			offsets[i] = handle->uniforms[set->dynamic_uniforms[i]].offset;
+		}
+
+		vkCmdBindDescriptorSets(current_command_buffer(video), VK_PIPELINE_BIND_POINT_GRAPHICS,
 			handle->pipeline_layout, static_cast<u32>(target), 1,
-			handle->desc_sets[index].sets + video->current_frame, 0, null);
+			set->sets + video->current_frame, static_cast<u32>(set->dynamic_count), offsets);
 	}
 
+	/* Nothing in the pipeline itself depends on the size of a framebuffer,
+	 * but re-created framebuffers have new image views, so the descriptors
+	 * that sample them have to be written again. */
 	void Pipeline::recreate() {
-		is_recreating = true;
+		for (usize i = 0; i < descriptor_set_count; i++) {
+			auto set = descriptor_sets + i;
+			auto v_set = handle->desc_sets + i;
+
+			for (usize ii = 0; ii < set->count; ii++) {
+				auto desc = set->descriptors + ii;
 
-		this->~Pipeline();
-		new(this) Pipeline(video, flags, shader, stride,
-			attribs, attrib_count, framebuffer, descriptor_sets, descriptor_set_count,
-			pcranges, pcrange_count, true);
+				if (desc->resource.type != ResourcePointer::Type::framebuffer_output) { continue; }
 
-		is_recreating = false;
+				auto fb = desc->resource.framebuffer.ptr;
+
+				VkDescriptorImageInfo image_infos[max_frames_in_flight];
+				VkWriteDescriptorSet desc_writes[max_frames_in_flight] = {};
+
+				for (usize j = 0; j < max_frames_in_flight; j++) {
+					image_infos[j].imageView   = fb->handle->attachment_map[desc->resource.framebuffer.attachment]->image_views[j];
+					image_infos[j].sampler     = desc->resource.framebuffer.sampler->handle->sampler;
+					image_infos[j].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+					desc_writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+					desc_writes[j].dstSet = v_set->sets[j];
+					desc_writes[j].dstBinding = desc->binding;
+					desc_writes[j].dstArrayElement = 0;
+					desc_writes[j].descriptorCount = 1;
+					desc_writes[j].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+					desc_writes[j].pImageInfo = image_infos + j;
+				}
+
+				vkUpdateDescriptorSets(video->handle->device, max_frames_in_flight, desc_writes, 0, null);
+			}
+		}
 	}
 
 	Framebuffer::Framebuffer(VideoContext* video, Flags flags, v2i size, Attachment* attachments, usize attachment_count, f32 scale, bool is_recreating) :
 		is_recreating(is_recreating), video(video), flags(flags), size(size), scale(scale) {
 
 		if (!is_recreating) {
+			gpu_timer_name = null;
 			cpu_copy_buffer(attachments, attachment_count, &this->attachments, &this->attachment_count);
 
 			video->framebuffers.push_back(this);
@@ -1773,9 +2421,9 @@ namespace vkr {
 				auto fmt = color_formats[i];
 
 				for (u32 ii = 0; ii < max_frames_in_flight; ii++) {
-					new_image(video->handle, v2i((i32)((f32)size.x * scale), (i32)((f32)size.y * scale)),
+					new_image(video->handle, get_scaled_size(),
 						fmt, VK_IMAGE_TILING_OPTIMAL,
-						VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+						VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
 						VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 						attachment->images + ii, attachment->image_memories + ii,
 						VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
@@ -1791,7 +2439,7 @@ namespace vkr {
 				for (u32 i = 0; i < max_frames_in_flight; i++) {
 					new_depth_resources(video->handle, &handle->depth.images[i],
 						&handle->depth.image_views[i], &handle->depth.image_memories[i],
-							v2i(static_cast<i32>(size.x * scale), static_cast<i32>(size.y * scale)), true);
+							get_scaled_size(), true);
 					handle->depth.type = Attachment::Type::depth;
 				}
 			}
@@ -1823,8 +2471,8 @@ namespace vkr {
 				fb_info.renderPass = handle->render_pass;
 				fb_info.attachmentCount = static_cast<u32>(attachment_count);
 				fb_info.pAttachments = image_attachments;
-				fb_info.width =  (u32)((f32)size.x * scale);
-				fb_info.height = (u32)((f32)size.y * scale);
+				fb_info.width =  (u32)get_scaled_size().x;
+				fb_info.height = (u32)get_scaled_size().y;
 				fb_info.layers = 1;
 
 				if (vkCreateFramebuffer(video->handle->device, &fb_info, null, handle->framebuffers + i) != VK_SUCCESS) {
@@ -1906,9 +2554,13 @@ namespace vkr {
 		is_recreating = false;
 	}
 
-	void Framebuffer::begin() {
+	void Framebuffer::begin(bool command_lists) {
 		if (video->skip_frame) { return; }
 
+		if (gpu_timer_name) {
+			video->begin_gpu_timer(gpu_timer_name);
+		}
+
 		if (flags & Flags::headless) {
 			/* Transition the image layouts into layouts for writing to. */
 
@@ -1953,7 +2605,8 @@ namespace vkr {
 		render_pass_info.clearValueCount = static_cast<u32>(handle->clear_color_count);
 		render_pass_info.pClearValues = handle->clear_colors;
 
-		vkCmdBeginRenderPass(video->handle->command_buffers[video->current_frame], &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBeginRenderPass(video->handle->command_buffers[video->current_frame], &render_pass_info,
+			command_lists ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
 	}
 
 	void Framebuffer::end() {
@@ -1998,6 +2651,83 @@ namespace vkr {
 					0, 0, null, 0, null, 1, &barrier);
 			}
 		}
+
+		if (gpu_timer_name) {
+			video->end_gpu_timer();
+		}
+	}
+
+	bool Framebuffer::read_back(u32 attachment, void* dst) {
+		if (!(flags & Flags::headless)) {
+			warning("Only headless framebuffers can be read back.");
+			return false;
+		}
+
+		if (attachment >= attachment_count ||
+			attachments[attachment].type != Attachment::Type::color ||
+			attachments[attachment].format != Attachment::Format::rgba8) {
+			warning("Only rgba8 colour attachments can be read back.");
+			return false;
+		}
+
+		video->wait_for_done();
+
+		/* The copy from the last frame that was ended. */
+		u32 frame = (video->current_frame + max_frames_in_flight - 1) % max_frames_in_flight;
+		VkImage image = handle->attachment_map[attachment]->images[frame];
+
+		v2i image_size = get_scaled_size();
+		VkDeviceSize size = (VkDeviceSize)image_size.x * (VkDeviceSize)image_size.y * 4;
+
+		VkBuffer buffer;
+		VmaAllocation memory;
+		new_buffer(video->handle, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT, &buffer, &memory);
+
+		auto command_buffer = begin_temp_command_buffer(video->handle);
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.image = image;
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+		vkCmdPipelineBarrier(command_buffer,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, null, 0, null, 1, &barrier);
+
+		VkBufferImageCopy region{};
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent = { (u32)image_size.x, (u32)image_size.y, 1 };
+
+		vkCmdCopyImageToBuffer(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, &region);
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(command_buffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, 0, null, 0, null, 1, &barrier);
+
+		end_temp_command_buffer(video->handle, command_buffer);
+
+		void* data;
+		vmaMapMemory(video->handle->allocator, memory, &data);
+		memcpy(dst, data, (usize)size);
+		vmaUnmapMemory(video->handle->allocator, memory);
+
+		vmaDestroyBuffer(video->handle->allocator, buffer, memory);
+
+		return true;
 	}
 
 	Buffer::Buffer(VideoContext* video) : video(video) {
@@ -2064,13 +2794,13 @@ namespace vkr {
 		}
 
 		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(video->handle->command_buffers[video->current_frame], 0, 1, &vb, offsets);
+		vkCmdBindVertexBuffers(current_command_buffer(video), 0, 1, &vb, offsets);
 	}
 
 	void VertexBuffer::draw(usize count, usize offset) {
 		if (video->skip_frame) { return; }
 
-		vkCmdDraw(video->handle->command_buffers[video->current_frame], static_cast<u32>(count), 1, static_cast<u32>(offset), 0);
+		vkCmdDraw(current_command_buffer(video), static_cast<u32>(count), 1, static_cast<u32>(offset), 0);
 	}
 
 	void VertexBuffer::update(void* verts, usize size, usize offset) {
@@ -2116,12 +2846,88 @@ namespace vkr {
 	void IndexBuffer::draw() {
 		if (video->skip_frame) { return; }
 
-		vkCmdBindIndexBuffer(video->handle->command_buffers[video->current_frame], handle->buffer, 0, VK_INDEX_TYPE_UINT16);
-		vkCmdDrawIndexed(video->handle->command_buffers[video->current_frame], static_cast<u32>(count), 1, 0, 0, 0);
+		vkCmdBindIndexBuffer(current_command_buffer(video), handle->buffer, 0, VK_INDEX_TYPE_UINT16);
+		vkCmdDrawIndexed(current_command_buffer(video), static_cast<u32>(count), 1, 0, 0, 0);
 
 		video->object_count++;
 	}
 
+	CommandList::CommandList(VideoContext* video) : video(video) {
+		handle = new impl_CommandList();
+
+		VkCommandPoolCreateInfo pool_info{};
+		pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		pool_info.queueFamilyIndex = video->handle->graphics_family;
+
+		if (vkCreateCommandPool(video->handle->device, &pool_info, null, &handle->pool) != VK_SUCCESS) {
+			abort_with("Failed to create command pool.");
+		}
+
+		VkCommandBufferAllocateInfo cb_alloc_info{};
+		cb_alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		cb_alloc_info.commandPool = handle->pool;
+		cb_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		cb_alloc_info.commandBufferCount = max_frames_in_flight;
+
+		if (vkAllocateCommandBuffers(video->handle->device, &cb_alloc_info, handle->buffers) != VK_SUCCESS) {
+			abort_with("Failed to allocate command buffers.");
+		}
+	}
+
+	CommandList::~CommandList() {
+		video->wait_for_done();
+
+		vkDestroyCommandPool(video->handle->device, handle->pool, null);
+
+		delete handle;
+	}
+
+	void CommandList::begin(Framebuffer* framebuffer) {
+		if (video->skip_frame) { return; }
+
+		if (recording_list != VK_NULL_HANDLE) {
+			abort_with("A command list is already being recorded on this thread.");
+		}
+
+		auto cb = handle->buffers[video->current_frame];
+
+		vkResetCommandBuffer(cb, 0);
+
+		VkCommandBufferInheritanceInfo inheritance_info{};
+		inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritance_info.renderPass = framebuffer->handle->render_pass;
+		inheritance_info.subpass = 0;
+		inheritance_info.framebuffer = framebuffer->handle->get_current_framebuffer(video->image_id, video->current_frame);
+
+		VkCommandBufferBeginInfo begin_info{};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		begin_info.pInheritanceInfo = &inheritance_info;
+
+		if (vkBeginCommandBuffer(cb, &begin_info) != VK_SUCCESS) {
+			abort_with("Failed to begin a command list.");
+		}
+
+		recording_list = cb;
+	}
+
+	void CommandList::end() {
+		if (video->skip_frame) { return; }
+
+		if (vkEndCommandBuffer(recording_list) != VK_SUCCESS) {
+			abort_with("Failed to end a command list.");
+		}
+
+		recording_list = VK_NULL_HANDLE;
+	}
+
+	void CommandList::execute() {
+		if (video->skip_frame) { return; }
+
+		vkCmdExecuteCommands(video->handle->command_buffers[video->current_frame], 1, handle->buffers + video->current_frame);
+	}
+
 	Sampler::Sampler(VideoContext* video, Flags flags) : video(video) {
 		handle = new impl_Sampler();
 
@@ -2227,19 +3033,50 @@ namespace vkr {
 		memcpy(remote_data, data, image_size);
 		vmaUnmapMemory(video->handle->allocator, stage_buffer_memory);
 
+		/* Linearly filtered textures get a full mip chain, so that they
+		 * don't alias when they're minified. The blits that fill it in
+		 * need the format to support them. */
+		u32 mip_levels = 1;
+		if (flags & Flags::filter_linear) {
+			VkFormatProperties format_props;
+			vkGetPhysicalDeviceFormatProperties(video->handle->pdevice, format, &format_props);
+
+			VkFormatFeatureFlags needed =
+				VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+				VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+			if ((format_props.optimalTilingFeatures & needed) == needed) {
+				for (i32 s = std::max(size.x, size.y); s > 1; s /= 2) {
+					mip_levels++;
+				}
+			} else {
+				warning("Texture format doesn't support linear blits; not generating mipmaps.");
+			}
+		}
+
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		if (mip_levels > 1) {
+			usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		}
+
 		new_image(video->handle, size, format, VK_IMAGE_TILING_OPTIMAL,
-			VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			&handle->image, &handle->memory);
+			usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&handle->image, &handle->memory, VK_IMAGE_LAYOUT_UNDEFINED, false, mip_levels);
 		
 		change_image_layout(video->handle, handle->image, format,
-				VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+				VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, false, mip_levels);
 		copy_buffer_to_image(video->handle, stage_buffer, handle->image, size);
-		change_image_layout(video->handle, handle->image, format,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		if (mip_levels > 1) {
+			generate_mipmaps(video->handle, handle->image, size, mip_levels);
+		} else {
+			change_image_layout(video->handle, handle->image, format,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		}
 	
 		vmaDestroyBuffer(video->handle->allocator, stage_buffer, stage_buffer_memory);
 
-		handle->view = new_image_view(video->handle, handle->image, format, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_VIEW_TYPE_2D);
+		handle->view = new_image_view(video->handle, handle->image, format, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_VIEW_TYPE_2D, mip_levels);
 
 		/* Used to get the anisotropy level that the hardware supports. */
 		VkPhysicalDeviceProperties pprops{};
@@ -2259,6 +3096,9 @@ namespace vkr {
 		sampler_info.compareEnable = VK_FALSE;
 		sampler_info.compareOp = VK_COMPARE_OP_ALWAYS;
 		sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		sampler_info.mipLodBias = 0.0f;
+		sampler_info.minLod = 0.0f;
+		sampler_info.maxLod = static_cast<f32>(mip_levels);
 
 		if (vkCreateSampler(video->handle->device, &sampler_info, null, &handle->sampler) != VK_SUCCESS) {
 			abort_with("Failed to create texture sampler.");
@@ -2274,6 +3114,8 @@ namespace vkr {
 	}
 
 	Texture* Texture::from_file(VideoContext* video, const char* file_path, Flags flags) {
+		profile_function();
+
 		usize raw_size;
 		u8* raw_data;
 		if (!read_raw(file_path, &raw_data, &raw_size)) {
@@ -2308,6 +3150,8 @@ namespace vkr {
 	}
 
 	Shader* Shader::from_file(VideoContext* video, const char* vert_path, const char* frag_path) {
+		profile_function();
+
 		u8* v_buf; usize v_size;
 		u8* f_buf; usize f_size;
 
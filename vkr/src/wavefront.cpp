@@ -4,6 +4,7 @@
 #include <sstream>
 #include <string>
 
+#include "profiler.hpp"
 #include "wavefront.hpp"
 #include "vkr.hpp"
 
@@ -148,6 +149,8 @@ namespace vkr {
 	}
 
 	WavefrontModel* WavefrontModel::from_file(const char* filename) {
+		profile_function();
+
 		u8* raw_data;
 		usize raw_size;
 
@@ -0,0 +1,102 @@
+#include "workers.hpp"
+
+namespace vkr {
+	WorkerPool::WorkerPool(usize thread_count) : quit(false) {
+		if (thread_count == 0) {
+			thread_count = std::thread::hardware_concurrency();
+		}
+
+		if (thread_count == 0) {
+			thread_count = 1;
+		}
+
+		threads.reserve(thread_count - 1);
+		for (usize i = 0; i < thread_count - 1; i++) {
+			threads.emplace_back(&WorkerPool::worker_main, this);
+		}
+	}
+
+	WorkerPool::~WorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+
+		wake.notify_all();
+
+		for (auto& thread : threads) {
+			thread.join();
+		}
+	}
+
+	void WorkerPool::work(Batch* batch) {
+		for (usize i = batch->next++; i < batch->count; i = batch->next++) {
+			(*batch->f)(i);
+		}
+	}
+
+	void WorkerPool::worker_main() {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		for (;;) {
+			wake.wait(lock, [&]() { return quit || !queue.empty(); });
+			if (quit) { return; }
+
+			Batch* batch = queue.front();
+			batch->workers++;
+
+			lock.unlock();
+			work(batch);
+			lock.lock();
+
+			/* Every job has been taken, so nobody else should pick it up. */
+			if (!queue.empty() && queue.front() == batch) {
+				queue.pop_front();
+			}
+
+			if (--batch->workers == 0) {
+				finished.notify_all();
+			}
+		}
+	}
+
+	void WorkerPool::run(usize count, const std::function<void(usize)>& f) {
+		if (count == 0) { return; }
+
+		if (threads.empty() || count == 1) {
+			for (usize i = 0; i < count; i++) {
+				f(i);
+			}
+
+			return;
+		}
+
+		Batch batch;
+		batch.f = &f;
+		batch.count = count;
+		batch.next = 0;
+		batch.workers = 0;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(&batch);
+		}
+
+		wake.notify_all();
+
+		work(&batch);
+
+		/* The batch lives on this stack, so it has to be off the queue and
+		 * out of every worker's hands before returning. */
+		std::unique_lock<std::mutex> lock(mutex);
+
+		for (auto it = queue.begin(); it != queue.end(); it++) {
+			if (*it == &batch) {
+				queue.erase(it);
+				break;
+			}
+		}
+
+		finished.wait(lock, [&]() { return batch.workers == 0; });
+	}
+}